@@ -0,0 +1,58 @@
+#pragma once
+
+#include "error.hpp"
+#include "measure-calculator.hpp"
+#include "spec.hpp"
+#include "thread-pool.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <span>
+#include <string_view>
+#include <variant>
+
+namespace Calc {
+
+struct BatchOptions {
+    // at most this many threads evaluate the batch, 0 for every core
+    std::size_t threads = 0;
+};
+
+// results[i] = Evaluate(spec, expressions[i]) for every i, evaluated in parallel on a shared
+// thread pool. Only as many expressions are evaluated as there are results. Custom functions of
+// the spec are called from multiple threads at once.
+inline void EvaluateBatch(const Spec& spec, std::span<const std::string_view> expressions,
+                          std::span<std::variant<double, Error>> results,
+                          BatchOptions options = {}) {
+    // expressions are usually evaluated in a microsecond or so
+    constexpr std::uint32_t kChunkSize = 16;
+
+    auto& pool = Detail::ThreadPool::Shared();
+    const auto participants =
+        options.threads == 0 ? pool.Size() : std::min(options.threads, pool.Size());
+
+    auto count = std::min(expressions.size(), results.size());
+    for (std::size_t offset = 0; count > 0;) {
+        const auto roundCount = static_cast<std::uint32_t>(
+            std::min<std::size_t>(count, std::numeric_limits<std::uint32_t>::max()));
+        const auto roundParticipants = std::min<std::size_t>(
+            participants, (roundCount + kChunkSize - 1) / kChunkSize);
+
+        Detail::WorkStealingRanges ranges(roundCount, roundParticipants, kChunkSize);
+        pool.Run(roundParticipants, [&](std::size_t participant) {
+            while (auto chunk = ranges.Next(participant)) {
+                for (auto i = offset + chunk->first; i < offset + chunk->second; ++i) {
+                    results[i] = Evaluate(spec, expressions[i]);
+                }
+            }
+        });
+
+        offset += roundCount;
+        count -= roundCount;
+    }
+}
+
+} // namespace Calc
@@ -0,0 +1,105 @@
+#pragma once
+
+#include "data.hpp"
+
+#include <cmath>
+#include <functional>
+#include <limits>
+
+namespace Calc {
+
+namespace Detail {
+
+// An operation of a Spec. Literal, so that it can be part of tables built at compile time.
+template <class Builtin, class Signature>
+struct Call {
+    Builtin builtin = {};
+
+    // for the Custom builtin: a plain function, or else a callable owned by the Spec
+    Signature* function = nullptr;
+    const std::function<Signature>* callable = nullptr;
+
+    constexpr bool IsValid() const {
+        return builtin != Builtin::Custom || function != nullptr || callable != nullptr;
+    }
+};
+
+using UnaryCall = Call<UnaryBuiltin, double(double)>;
+using BinaryCall = Call<BinaryBuiltin, double(double, double)>;
+
+// Direct calls of the builtins, so that the compiler sees (and can inline) the arithmetic.
+
+inline double ApplyBuiltin(UnaryBuiltin builtin, double value) {
+    switch (builtin) {
+        // not a builtin, the callers call func instead
+        case UnaryBuiltin::Custom: break;
+
+        case UnaryBuiltin::Negate: return -value;
+        case UnaryBuiltin::Abs: return std::abs(value);
+        case UnaryBuiltin::Ceil: return std::ceil(value);
+        case UnaryBuiltin::Floor: return std::floor(value);
+        case UnaryBuiltin::Round: return std::round(value);
+
+        case UnaryBuiltin::Exp: return std::exp(value);
+        case UnaryBuiltin::Exp2: return std::exp2(value);
+        case UnaryBuiltin::Sqrt: return std::sqrt(value);
+        case UnaryBuiltin::Ln: return std::log(value);
+        case UnaryBuiltin::Log2: return std::log2(value);
+        case UnaryBuiltin::Log10: return std::log10(value);
+
+        case UnaryBuiltin::Sin: return std::sin(value);
+        case UnaryBuiltin::Cos: return std::cos(value);
+        case UnaryBuiltin::Tan: return std::tan(value);
+        case UnaryBuiltin::Asin: return std::asin(value);
+        case UnaryBuiltin::Acos: return std::acos(value);
+        case UnaryBuiltin::Atan: return std::atan(value);
+        case UnaryBuiltin::Sinh: return std::sinh(value);
+        case UnaryBuiltin::Cosh: return std::cosh(value);
+        case UnaryBuiltin::Tanh: return std::tanh(value);
+        case UnaryBuiltin::Asinh: return std::asinh(value);
+        case UnaryBuiltin::Acosh: return std::acosh(value);
+        case UnaryBuiltin::Atanh: return std::atanh(value);
+    }
+
+    return std::numeric_limits<double>::quiet_NaN();
+}
+
+inline double ApplyBuiltin(BinaryBuiltin builtin, double left, double right) {
+    switch (builtin) {
+        case BinaryBuiltin::Custom: break;
+
+        case BinaryBuiltin::Add: return left + right;
+        case BinaryBuiltin::Subtract: return left - right;
+        case BinaryBuiltin::Multiply: return left * right;
+        case BinaryBuiltin::Divide: return left / right;
+
+        case BinaryBuiltin::Min: return std::fmin(left, right);
+        case BinaryBuiltin::Max: return std::fmax(left, right);
+        case BinaryBuiltin::Pow: return std::pow(left, right);
+    }
+
+    return std::numeric_limits<double>::quiet_NaN();
+}
+
+// only for the Custom builtin
+template <class Builtin, class Signature, class... Args>
+double ApplyCustom(const Call<Builtin, Signature>& call, Args... args) {
+    if (call.function) {
+        return call.function(args...);
+    }
+
+    return (*call.callable)(args...);
+}
+
+template <class Builtin, class Signature, class... Args>
+double Apply(const Call<Builtin, Signature>& call, Args... args) {
+    if (call.builtin == Builtin::Custom) {
+        return ApplyCustom(call, args...);
+    }
+
+    return ApplyBuiltin(call.builtin, args...);
+}
+
+} // namespace Detail
+
+} // namespace Calc
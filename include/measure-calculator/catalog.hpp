@@ -0,0 +1,139 @@
+#pragma once
+
+#include "data.hpp"
+#include "spec.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <istream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <variant>
+#include <vector>
+
+namespace Calc {
+
+// Measures, units and constants loaded from a text catalog, to add to a SpecBuilder. It owns the
+// names its specs view, so it must outlive building the Spec (but not the Spec itself).
+class Catalog {
+  public:
+    std::vector<MeasureSpec> measures;
+    SpecFor<Constant> constants;
+
+    // the arena for the names, copied here so that the specs can view them
+    std::string_view Store(std::string_view name) {
+        if (chunks.empty() || name.size() > kChunkSize - chunkUsed) {
+            chunks.push_back(std::make_unique<char[]>(std::max(kChunkSize, name.size())));
+            chunkUsed = 0;
+        }
+
+        auto* first = chunks.back().get() + chunkUsed;
+        std::copy(name.begin(), name.end(), first);
+        // longer names get a chunk of their own
+        chunkUsed = std::min(chunkUsed + name.size(), kChunkSize);
+        return {first, name.size()};
+    }
+
+  private:
+    static constexpr std::size_t kChunkSize = 1 << 16;
+
+    std::vector<std::unique_ptr<char[]>> chunks;
+    std::size_t chunkUsed = 0;
+};
+
+struct CatalogError {
+    enum class Kind {
+        // the first field is not measure, unit or constant
+        UnknownRecord,
+        // too few or too many fields for the record
+        InvalidFieldCount,
+        InvalidNumber,
+        // a unit before the first measure
+        UnitWithoutMeasure,
+        // reading from the stream failed
+        ReadFailed,
+    };
+
+    Kind kind;
+    // 1-based
+    std::size_t line;
+
+    bool operator==(const CatalogError& other) const = default;
+};
+
+// Reads a catalog of tab separated records, one per line:
+//     measure <name>
+//     unit <name> <multiplier>
+//     constant <name> <value>
+// Units belong to the measure before them. Empty lines and lines starting with # are skipped.
+// The names are not validated here, but when the Spec is built.
+inline std::variant<Catalog, CatalogError> LoadCatalog(std::istream& input) {
+    using Kind = CatalogError::Kind;
+
+    Catalog result;
+
+    // reused for every line
+    std::string line;
+    std::vector<std::string_view> fields;
+
+    const auto parseNumber = [](std::string_view field, double& value) {
+        const auto [end, error] = std::from_chars(field.data(), field.data() + field.size(), value);
+        return error == std::errc() && end == field.data() + field.size();
+    };
+
+    for (std::size_t lineNumber = 1; std::getline(input, line); ++lineNumber) {
+        std::string_view rest = line;
+        if (!rest.empty() && rest.back() == '\r') {
+            rest.remove_suffix(1);
+        }
+        if (rest.empty() || rest.front() == '#') {
+            continue;
+        }
+
+        fields.clear();
+        for (auto tab = rest.find('\t'); tab != std::string_view::npos; tab = rest.find('\t')) {
+            fields.push_back(rest.substr(0, tab));
+            rest.remove_prefix(tab + 1);
+        }
+        fields.push_back(rest);
+
+        const auto kind = fields.front();
+        if (kind != "measure" && kind != "unit" && kind != "constant") {
+            return CatalogError{.kind = Kind::UnknownRecord, .line = lineNumber};
+        }
+        if (fields.size() != (kind == "measure" ? 2u : 3u)) {
+            return CatalogError{.kind = Kind::InvalidFieldCount, .line = lineNumber};
+        }
+
+        if (kind == "measure") {
+            result.measures.push_back({.name = result.Store(fields[1])});
+            continue;
+        }
+
+        double value = 0.;
+        if (!parseNumber(fields[2], value)) {
+            return CatalogError{.kind = Kind::InvalidNumber, .line = lineNumber};
+        }
+
+        if (kind == "constant") {
+            result.constants.emplace_back(result.Store(fields[1]), value);
+            continue;
+        }
+
+        if (result.measures.empty()) {
+            return CatalogError{.kind = Kind::UnitWithoutMeasure, .line = lineNumber};
+        }
+        result.measures.back().units.emplace_back(result.Store(fields[1]), value);
+    }
+
+    if (input.bad()) {
+        return CatalogError{.kind = Kind::ReadFailed, .line = 0};
+    }
+
+    return result;
+}
+
+} // namespace Calc
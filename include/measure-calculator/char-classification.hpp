@@ -1,62 +1,135 @@
 #pragma once
 
-#include <cctype>
+#include "simd.hpp"
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
 
 namespace Calc {
 
 namespace Detail {
 
-inline bool IsOperatorChar(char c) {
-    switch (c) {
-        case '+':
-        case '-':
-        case '>':
-        case '<':
-        case '=':
-        case '!':
-        case '~':
-        case '*':
-        case '/':
-        case '^':
-        case '%':
-        case '&':
-        case '|':
-        case '@':
-        case '#': return true;
-        default: return false;
+// the classes a char can be in, a char can be in several of them
+enum CharClass : std::uint8_t {
+    kWhiteSpace = 1 << 0,
+    kDigit = 1 << 1,
+    kOperatorChar = 1 << 2,
+    kReservedChar = 1 << 3,
+    kIdentifierStartChar = 1 << 4,
+    kIdentifierChar = 1 << 5,
+};
+
+// the CharClasses of each char, indexed by its unsigned value
+inline constexpr std::array<std::uint8_t, 256> kCharClasses = [] {
+    std::array<std::uint8_t, 256> classes{};
+    const auto add = [&classes](std::string_view chars, CharClass charClass) {
+        for (const char c : chars) {
+            classes[static_cast<unsigned char>(c)] |= charClass;
+        }
+    };
+
+    add("+-><=!~*/^%&|@#", kOperatorChar);
+    add("()[]{},.;", kReservedChar);
+    // the ones of std::isspace and std::isdigit in the "C" locale
+    add(" \t\n\v\f\r", kWhiteSpace);
+    add("0123456789", kDigit);
+
+    // everything else, including the bytes of non-ASCII characters
+    for (auto& charClasses : classes) {
+        if ((charClasses & (kOperatorChar | kReservedChar | kWhiteSpace)) == 0) {
+            charClasses |= (charClasses & kDigit) ? kIdentifierChar
+                                                  : kIdentifierChar | kIdentifierStartChar;
+        }
     }
+
+    return classes;
+}();
+
+constexpr bool IsOfClass(char c, CharClass charClass) {
+    return (kCharClasses[static_cast<unsigned char>(c)] & charClass) != 0;
 }
 
-inline bool IsReservedChar(char c) {
-    switch (c) {
-        case '(':
-        case ')':
-        case '[':
-        case ']':
-        case '{':
-        case '}':
-        case ',':
-        case '.':
-        case ';': return true;
-        default: return false;
+constexpr bool IsOperatorChar(char c) { return IsOfClass(c, kOperatorChar); }
+
+constexpr bool IsReservedChar(char c) { return IsOfClass(c, kReservedChar); }
+
+constexpr bool IsAscii(char c) { return c >= 0; }
+
+constexpr bool IsWhiteSpace(char c) { return IsOfClass(c, kWhiteSpace); }
+
+constexpr bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+constexpr bool IsIdentifierStartChar(char c) { return IsOfClass(c, kIdentifierStartChar); }
+
+constexpr bool IsIdentifierChar(char c) { return IsOfClass(c, kIdentifierChar); }
+
+#if defined(MEASURE_CALCULATOR_SIMD_BYTES)
+
+// The length of a prefix of the run of chars of charClass at the start of str, 16 chars at a
+// time. It is the whole run for whitespace and digits, but only the part of letters, digits,
+// '_' and non-ASCII characters for identifiers, the rest is left to the caller.
+inline std::size_t SimdRunLength(std::string_view str, CharClass charClass) {
+    if (charClass != kWhiteSpace && charClass != kDigit && charClass != kIdentifierChar) {
+        return 0;
     }
-}
 
-inline bool IsAscii(char c) { return c >= 0; }
+    // the chars from first to last, compared as signed chars, so that non-ASCII ones are never
+    // in the range
+    const auto inRange = [](__m128i chars, char first, char last) {
+        return _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8(static_cast<char>(first - 1))),
+                             _mm_cmplt_epi8(chars, _mm_set1_epi8(static_cast<char>(last + 1))));
+    };
 
-inline bool IsWhiteSpace(char c) { return IsAscii(c) && std::isspace(c); }
+    std::size_t length = 0;
+    for (; length + 16 <= str.size(); length += 16) {
+        const auto chars =
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(str.data() + length));
 
-inline bool IsDigit(char c) { return IsAscii(c) && std::isdigit(c); }
+        __m128i matches;
+        if (charClass == kWhiteSpace) {
+            matches = _mm_or_si128(_mm_cmpeq_epi8(chars, _mm_set1_epi8(' ')),
+                                   inRange(chars, '\t', '\r'));
+        } else if (charClass == kDigit) {
+            matches = inRange(chars, '0', '9');
+        } else {
+            // the sign bit of a non-ASCII byte is set, just like those of matches
+            matches = _mm_or_si128(
+                _mm_or_si128(inRange(chars, 'a', 'z'), inRange(chars, 'A', 'Z')),
+                _mm_or_si128(_mm_or_si128(inRange(chars, '0', '9'),
+                                          _mm_cmpeq_epi8(chars, _mm_set1_epi8('_'))),
+                             _mm_cmplt_epi8(chars, _mm_setzero_si128())));
+        }
 
-inline bool IsIdentifierStartChar(char c) {
-    return !IsAscii(c) ||
-           (!IsOperatorChar(c) && !IsReservedChar(c) && !std::isdigit(c) && !std::isspace(c));
+        const auto mask = static_cast<unsigned>(_mm_movemask_epi8(matches));
+        if (mask != 0xFFFF) {
+            return length + std::countr_one(mask);
+        }
+    }
+
+    return length;
 }
 
-inline bool IsIdentifierChar(char c) {
-    return !IsAscii(c) || (!IsOperatorChar(c) && !IsReservedChar(c) && !std::isspace(c));
+#endif
+
+// the length of the run of chars of charClass at the start of str
+inline std::size_t RunLength(std::string_view str, CharClass charClass) {
+    std::size_t length = 0;
+    while (length < str.size() && IsOfClass(str[length], charClass)) {
+        ++length;
+#if defined(MEASURE_CALCULATOR_SIMD_BYTES)
+        // most runs are short, those are not worth a vector
+        if (length == 8) {
+            length += SimdRunLength(str.substr(length), charClass);
+        }
+#endif
+    }
+
+    return length;
 }
 
 } // namespace Detail
 
-} // namespace Calc
\ No newline at end of file
+} // namespace Calc
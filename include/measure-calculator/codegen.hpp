@@ -0,0 +1,256 @@
+#pragma once
+
+#include "builtins.hpp"
+#include "char-classification.hpp"
+#include "compiled-expression.hpp"
+#include "error.hpp"
+#include "measure-calculator.hpp"
+#include "spec.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+namespace Calc {
+
+struct NamedExpression {
+    // the name of the generated function, a C++ identifier
+    std::string_view name;
+    std::string_view expression;
+};
+
+struct GenerationError {
+    enum class Kind {
+        InvalidName,
+        // see error
+        InvalidExpression,
+        // custom functions exist only at runtime
+        CustomFunction,
+    };
+
+    Kind kind;
+    // the name of the NamedExpression
+    std::string_view name;
+    std::optional<Error> error = std::nullopt;
+
+    bool operator==(const GenerationError& other) const = default;
+};
+
+namespace Detail {
+
+struct CppTranslation {
+    static std::string Literal(double value) {
+        if (std::isnan(value)) {
+            return "std::numeric_limits<double>::quiet_NaN()";
+        }
+        if (std::isinf(value)) {
+            return value > 0 ? "std::numeric_limits<double>::infinity()"
+                             : "(-std::numeric_limits<double>::infinity())";
+        }
+
+        // the shortest form which reads back as the same value
+        char buffer[32];
+        const auto end = std::to_chars(buffer, buffer + sizeof(buffer), value).ptr;
+        std::string result(buffer, end);
+        if (result.find_first_of(".e") == std::string::npos) {
+            result += ".0";
+        }
+
+        return std::signbit(value) ? "(" + result + ")" : result;
+    }
+
+    static std::string_view FunctionOf(UnaryBuiltin builtin) {
+        switch (builtin) {
+            case UnaryBuiltin::Custom:
+            case UnaryBuiltin::Negate: break;
+
+            case UnaryBuiltin::Abs: return "std::abs";
+            case UnaryBuiltin::Ceil: return "std::ceil";
+            case UnaryBuiltin::Floor: return "std::floor";
+            case UnaryBuiltin::Round: return "std::round";
+
+            case UnaryBuiltin::Exp: return "std::exp";
+            case UnaryBuiltin::Exp2: return "std::exp2";
+            case UnaryBuiltin::Sqrt: return "std::sqrt";
+            case UnaryBuiltin::Ln: return "std::log";
+            case UnaryBuiltin::Log2: return "std::log2";
+            case UnaryBuiltin::Log10: return "std::log10";
+
+            case UnaryBuiltin::Sin: return "std::sin";
+            case UnaryBuiltin::Cos: return "std::cos";
+            case UnaryBuiltin::Tan: return "std::tan";
+            case UnaryBuiltin::Asin: return "std::asin";
+            case UnaryBuiltin::Acos: return "std::acos";
+            case UnaryBuiltin::Atan: return "std::atan";
+            case UnaryBuiltin::Sinh: return "std::sinh";
+            case UnaryBuiltin::Cosh: return "std::cosh";
+            case UnaryBuiltin::Tanh: return "std::tanh";
+            case UnaryBuiltin::Asinh: return "std::asinh";
+            case UnaryBuiltin::Acosh: return "std::acosh";
+            case UnaryBuiltin::Atanh: return "std::atanh";
+        }
+
+        return "";
+    }
+
+    static std::string Apply(BinaryBuiltin builtin, const std::string& left,
+                             const std::string& right) {
+        switch (builtin) {
+            case BinaryBuiltin::Custom: break;
+
+            case BinaryBuiltin::Add: return "(" + left + " + " + right + ")";
+            case BinaryBuiltin::Subtract: return "(" + left + " - " + right + ")";
+            case BinaryBuiltin::Multiply: return "(" + left + " * " + right + ")";
+            case BinaryBuiltin::Divide: return "(" + left + " / " + right + ")";
+
+            case BinaryBuiltin::Min: return "std::fmin(" + left + ", " + right + ")";
+            case BinaryBuiltin::Max: return "std::fmax(" + left + ", " + right + ")";
+            case BinaryBuiltin::Pow: return "std::pow(" + left + ", " + right + ")";
+        }
+
+        return "";
+    }
+
+    // The C++ expression computing the compiled expression, reading the inputs from the
+    // parameters named by ParameterName(), or nothing if it calls custom functions.
+    static std::optional<std::string> Translate(const CompiledExpression& compiled) {
+        using Code = Instruction::Code;
+
+        std::vector<std::string> stack;
+        for (const auto& instruction : compiled.instructions) {
+            std::string right;
+            if (instruction.PopsOperand()) {
+                right = std::move(stack.back());
+                stack.pop_back();
+            }
+
+            switch (instruction.code) {
+                case Code::Push: stack.push_back(Literal(instruction.operand.constant)); break;
+                case Code::Load: stack.push_back(ParameterName(instruction.operand.index)); break;
+                case Code::Duplicate: stack.push_back(stack.back()); break;
+                case Code::Scale:
+                    stack.back() = "(" + stack.back() + " * " +
+                                   Literal(instruction.operand.constant) + ")";
+                    break;
+                case Code::Negate: stack.back() = "(-" + stack.back() + ")"; break;
+                case Code::CallUnaryBuiltin:
+                    stack.back() = std::string(FunctionOf(instruction.operand.unaryBuiltin)) +
+                                   "(" + stack.back() + ")";
+                    break;
+                case Code::CallBinaryBuiltin:
+                case Code::CheckedCallBinaryBuiltin:
+                    stack.back() = Apply(instruction.operand.binaryBuiltin, stack.back(), right);
+                    break;
+                case Code::Add:
+                    stack.back() = Apply(BinaryBuiltin::Add, stack.back(), right);
+                    break;
+                case Code::Subtract:
+                    stack.back() = Apply(BinaryBuiltin::Subtract, stack.back(), right);
+                    break;
+                case Code::Multiply:
+                    stack.back() = Apply(BinaryBuiltin::Multiply, stack.back(), right);
+                    break;
+                case Code::Divide:
+                    stack.back() = Apply(BinaryBuiltin::Divide, stack.back(), right);
+                    break;
+                case Code::CallUnary:
+                case Code::CallBinary:
+                case Code::CheckedCallBinary: return std::nullopt;
+            }
+        }
+
+        return std::move(stack.back());
+    }
+
+    static std::string ParameterName(std::size_t index) { return "input" + std::to_string(index); }
+
+    // the parameters of the inputs the compiled expression reads, named after their variables
+    static std::string Parameters(const CompiledExpression& compiled, std::string_view str) {
+        std::string result;
+        for (std::size_t i = 0; i < compiled.inputSources.size(); ++i) {
+            const auto [first, last] = compiled.inputSources[i];
+            if (first == last) {
+                continue;
+            }
+
+            if (!result.empty()) {
+                result += ", ";
+            }
+            result += "double " + ParameterName(i) + " /* " +
+                      std::string(str.substr(first, last - first)) + " */";
+        }
+
+        return result;
+    }
+
+    static bool IsCppIdentifier(std::string_view name) {
+        const auto isStart = [](char c) {
+            return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+        };
+        const auto isPart = [&](char c) { return isStart(c) || IsDigit(c); };
+        return !name.empty() && isStart(name.front()) &&
+               std::all_of(name.begin(), name.end(), isPart);
+    }
+};
+
+} // namespace Detail
+
+// A C++ header with an inline function for each of the expressions, computing its result from
+// the variables it reads, which are its parameters in the order of their indices. The lexing,
+// the measure checks and the units are resolved here, and the constant parts are folded.
+// Unlike Eval(), the generated functions do not check their intermediate results: where Eval()
+// would report an error they return NaN, an infinity, or whatever follows from those.
+inline std::variant<std::string, GenerationError>
+GenerateHeader(const Spec& spec, std::span<const NamedExpression> expressions,
+               std::string_view namespaceName = "Formulas") {
+    std::string result = "#pragma once\n"
+                         "\n"
+                         "// generated by Calc::GenerateHeader\n"
+                         "\n"
+                         "#include <cmath>\n"
+                         "#include <limits>\n"
+                         "\n"
+                         "namespace " +
+                         std::string(namespaceName) + " {\n";
+
+    for (const auto& [name, expression] : expressions) {
+        if (!Detail::CppTranslation::IsCppIdentifier(name)) {
+            return GenerationError{.kind = GenerationError::Kind::InvalidName, .name = name};
+        }
+
+        auto compiled = Compile(spec, expression);
+        if (auto* error = std::get_if<Error>(&compiled)) {
+            return GenerationError{
+                .kind = GenerationError::Kind::InvalidExpression,
+                .name = name,
+                .error = *error,
+            };
+        }
+
+        const auto& compiledExpression = std::get<CompiledExpression>(compiled);
+        auto body = Detail::CppTranslation::Translate(compiledExpression);
+        if (!body) {
+            return GenerationError{.kind = GenerationError::Kind::CustomFunction, .name = name};
+        }
+
+        std::string comment(expression);
+        std::replace_if(comment.begin(), comment.end(), Detail::IsWhiteSpace, ' ');
+        result += "\n// " + comment + "\n";
+        result += "inline double " + std::string(name) + "(" +
+                  Detail::CppTranslation::Parameters(compiledExpression, expression) + ") {\n";
+        result += "    return " + *body + ";\n";
+        result += "}\n";
+    }
+
+    result += "\n} // namespace " + std::string(namespaceName) + "\n";
+    return result;
+}
+
+} // namespace Calc
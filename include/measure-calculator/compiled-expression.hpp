@@ -0,0 +1,528 @@
+#pragma once
+
+#include "builtins.hpp"
+#include "error.hpp"
+#include "interpreter.hpp"
+#include "simd.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <variant>
+#include <vector>
+
+namespace Calc {
+
+namespace Detail {
+
+struct CppTranslation;
+
+struct Instruction {
+    enum class Code : std::uint8_t {
+        Push,
+        Load,
+        Duplicate,
+
+        Scale,
+        Negate,
+        CallUnary,
+        CallUnaryBuiltin,
+
+        // the ones below pop their right operand
+        CallBinary,
+        CallBinaryBuiltin,
+
+        // the ones below fail if their result is not finite
+        Add,
+        Subtract,
+        Multiply,
+        Divide,
+        CheckedCallBinary,
+        CheckedCallBinaryBuiltin,
+    };
+
+    union Operand {
+        double constant;
+        std::size_t index;
+        // only for the Custom builtin
+        const UnaryCall* unary;
+        const BinaryCall* binary;
+        UnaryBuiltin unaryBuiltin;
+        BinaryBuiltin binaryBuiltin;
+    };
+
+    Code code;
+    Operand operand = {.constant = 0.};
+
+    bool PopsOperand() const { return code >= Code::CallBinary; }
+    bool IsChecked() const { return code >= Code::Add; }
+};
+
+// Backend of the Interpreter emitting a postfix program instead of computing the result.
+// Subexpressions of literals and builtins are folded into a single Push while emitting, and the
+// arithmetic identities which cannot change the result are left out.
+struct Compilation {
+    // values live on the evaluation stack, their position is implied by the program
+    struct Value {
+        // the index of the first of the instructions computing the value, which end where the
+        // next value starts
+        std::size_t first = 0;
+    };
+
+    std::vector<Instruction> instructions;
+    // only set for the checked instructions, reported when the result is not finite
+    std::vector<SourceRange> sourceRanges;
+
+    std::size_t stackDepth = 0;
+    std::size_t maxStackDepth = 0;
+
+    // the first use of each input, {0, 0} for the ones not used
+    std::vector<SourceRange> inputSources;
+
+    Value Emit(Instruction instruction, int stackEffect, std::size_t first,
+               SourceRange sourceRange = {0, 0}) {
+        instructions.push_back(instruction);
+        sourceRanges.push_back(sourceRange);
+
+        stackDepth += stackEffect;
+        maxStackDepth = std::max(maxStackDepth, stackDepth);
+
+        return {.first = first};
+    }
+
+    // the value computed by the instructions [value.first, end) if it is a constant
+    std::optional<double> ConstantOf(Value value, std::size_t end) const {
+        if (end != value.first + 1 || instructions[value.first].code != Instruction::Code::Push) {
+            return std::nullopt;
+        }
+
+        return instructions[value.first].operand.constant;
+    }
+
+    // whether the value computed by the instructions [value.first, end) is known to be finite
+    bool IsFinite(Value value, std::size_t end) const {
+        if (auto constant = ConstantOf(value, end)) {
+            return std::isfinite(*constant);
+        }
+
+        return instructions[end - 1].IsChecked();
+    }
+
+    // replaces the instructions from first on, which compute values, with a Push of result
+    Value Fold(std::size_t first, std::size_t values, double result) {
+        instructions.resize(first);
+        sourceRanges.resize(first);
+        stackDepth -= values;
+
+        return Literal(result);
+    }
+
+    Value Literal(double value) {
+        const auto first = instructions.size();
+        return Emit({.code = Instruction::Code::Push, .operand = {.constant = value}}, 1, first);
+    }
+
+    std::variant<Value, Error::Kind> Input(const Variable& variable, SourceRange sourceRange) {
+        if (variable.index >= inputSources.size()) {
+            inputSources.resize(variable.index + 1, {0, 0});
+        }
+        if (inputSources[variable.index] == SourceRange{0, 0}) {
+            inputSources[variable.index] = sourceRange;
+        }
+
+        const auto first = instructions.size();
+        return Emit({.code = Instruction::Code::Load, .operand = {.index = variable.index}}, 1,
+                    first);
+    }
+
+    Value Duplicate(Value value) {
+        if (auto constant = ConstantOf(value, instructions.size())) {
+            return Literal(*constant);
+        }
+
+        const auto first = instructions.size();
+        return Emit({.code = Instruction::Code::Duplicate}, 1, first);
+    }
+
+    Value Scale(Value value, double multiplier) {
+        if (multiplier == 1.) {
+            return value;
+        }
+        if (auto constant = ConstantOf(value, instructions.size())) {
+            return Fold(value.first, 1, *constant * multiplier);
+        }
+
+        return Emit({.code = Instruction::Code::Scale, .operand = {.constant = multiplier}}, 0,
+                    value.first);
+    }
+
+    Value EmitUnary(const UnaryCall& call, Value inner) {
+        using Code = Instruction::Code;
+
+        if (call.builtin != UnaryBuiltin::Custom) {
+            if (auto constant = ConstantOf(inner, instructions.size())) {
+                return Fold(inner.first, 1, ApplyBuiltin(call.builtin, *constant));
+            }
+        }
+
+        switch (call.builtin) {
+            case UnaryBuiltin::Custom:
+                return Emit({.code = Code::CallUnary, .operand = {.unary = &call}}, 0,
+                            inner.first);
+            case UnaryBuiltin::Negate: return Emit({.code = Code::Negate}, 0, inner.first);
+            default:
+                return Emit({
+                                .code = Code::CallUnaryBuiltin,
+                                .operand = {.unaryBuiltin = call.builtin},
+                            },
+                            0, inner.first);
+        }
+    }
+
+    // x * 1, x / 1, x + -0 and x - 0, and the same with the constant on the left for + and *,
+    // if x is known to be finite so that leaving the check out does not matter either. x + 0 is
+    // not x for x = -0, so only -0 is neutral for +, and only 0 for -.
+    std::optional<Value> SimplifyIdentity(BinaryBuiltin builtin, Value left, Value right) {
+        const auto end = instructions.size();
+        const auto leftConstant = ConstantOf(left, right.first);
+        const auto rightConstant = ConstantOf(right, end);
+
+        const auto isNeutral = [builtin](std::optional<double> constant, bool onRight) {
+            if (!constant) {
+                return false;
+            }
+
+            switch (builtin) {
+                case BinaryBuiltin::Add: return *constant == 0. && std::signbit(*constant);
+                case BinaryBuiltin::Multiply: return *constant == 1.;
+                case BinaryBuiltin::Subtract:
+                    return onRight && *constant == 0. && !std::signbit(*constant);
+                case BinaryBuiltin::Divide: return onRight && *constant == 1.;
+                default: return false;
+            }
+        };
+
+        if (isNeutral(rightConstant, true) && IsFinite(left, right.first)) {
+            instructions.pop_back();
+            sourceRanges.pop_back();
+            --stackDepth;
+            return left;
+        }
+
+        if (isNeutral(leftConstant, false) && IsFinite(right, end)) {
+            instructions.erase(instructions.begin() + left.first);
+            sourceRanges.erase(sourceRanges.begin() + left.first);
+            --stackDepth;
+            return left;
+        }
+
+        return std::nullopt;
+    }
+
+    Value EmitBinary(const BinaryCall& call, bool checked, Value left, Value right,
+                     SourceRange sourceRange) {
+        using Code = Instruction::Code;
+
+        if (call.builtin == BinaryBuiltin::Custom) {
+            return Emit({
+                            .code = checked ? Code::CheckedCallBinary : Code::CallBinary,
+                            .operand = {.binary = &call},
+                        },
+                        -1, left.first, sourceRange);
+        }
+
+        const auto leftConstant = ConstantOf(left, right.first);
+        const auto rightConstant = ConstantOf(right, instructions.size());
+        if (leftConstant && rightConstant) {
+            // results which are not finite are left for Eval() to report
+            const auto result = ApplyBuiltin(call.builtin, *leftConstant, *rightConstant);
+            if (!checked || std::isfinite(result)) {
+                return Fold(left.first, 2, result);
+            }
+        }
+
+        if (checked) {
+            if (auto simplified = SimplifyIdentity(call.builtin, left, right)) {
+                return *simplified;
+            }
+        }
+
+        // the checked arithmetic gets instructions of its own
+        if (checked) {
+            switch (call.builtin) {
+                case BinaryBuiltin::Add:
+                    return Emit({.code = Code::Add}, -1, left.first, sourceRange);
+                case BinaryBuiltin::Subtract:
+                    return Emit({.code = Code::Subtract}, -1, left.first, sourceRange);
+                case BinaryBuiltin::Multiply:
+                    return Emit({.code = Code::Multiply}, -1, left.first, sourceRange);
+                case BinaryBuiltin::Divide:
+                    return Emit({.code = Code::Divide}, -1, left.first, sourceRange);
+                default: break;
+            }
+        }
+
+        return Emit({
+                        .code = checked ? Code::CheckedCallBinaryBuiltin : Code::CallBinaryBuiltin,
+                        .operand = {.binaryBuiltin = call.builtin},
+                    },
+                    -1, left.first, sourceRange);
+    }
+
+    Value UnaryOperator(const UnaryOpEntry& op, Value inner) { return EmitUnary(op.call, inner); }
+
+    std::variant<Value, Error::Kind> BinaryOperator(const BinaryOpEntry& op, Value left,
+                                                    Value right, SourceRange sourceRange) {
+        return EmitBinary(op.call, true, left, right, sourceRange);
+    }
+
+    Value UnaryFunction(const UnaryFunEntry& fun, Value inner) {
+        return EmitUnary(fun.call, inner);
+    }
+
+    Value BinaryFunction(const BinaryFunEntry& fun, Value left, Value right) {
+        return EmitBinary(fun.call, false, left, right, {0, 0});
+    }
+};
+
+} // namespace Detail
+
+// An expression parsed once against a Spec, which can be evaluated repeatedly.
+// Lexing, lookups and measure checks are done by Compile(), Eval() only does the arithmetic.
+// Refers to the callables of the Spec, so it must not outlive it.
+struct CompiledExpression {
+    CompiledExpression(CompiledExpression&&) = default;
+    CompiledExpression(const CompiledExpression&) = default;
+
+    CompiledExpression& operator=(CompiledExpression&&) = default;
+    CompiledExpression& operator=(const CompiledExpression&) = default;
+
+    // inputs[i] is the value of the variables with Variable::index == i
+    std::variant<double, Error> Eval(std::span<const double> inputs = {}) const {
+        if (inputs.size() < inputSources.size()) {
+            return Error{.kind = Error::Kind::UnboundVariable, .invalidRange = inputSources.back()};
+        }
+
+        // expressions rarely nest deep enough to need the heap
+        constexpr std::size_t kInlineStackSize = 32;
+        if (maxStackDepth <= kInlineStackSize) {
+            std::array<double, kInlineStackSize> stack;
+            return Run(stack.data(), inputs.data());
+        }
+
+        std::vector<double> stack(maxStackDepth);
+        return Run(stack.data(), inputs.data());
+    }
+
+    // Evaluates the expression for many rows in one pass: results[row] is the result for the
+    // inputs columns[i][row]. Every column used needs at least as many rows as results.
+    // Rows failing the way Eval() would (e.g. dividing by zero) are set to NaN.
+    std::optional<Error> EvalColumns(std::span<const std::span<const double>> columns,
+                                     std::span<double> results) const {
+        if (columns.size() < inputSources.size()) {
+            return Error{.kind = Error::Kind::UnboundVariable, .invalidRange = inputSources.back()};
+        }
+
+        for (std::size_t i = 0; i < inputSources.size(); ++i) {
+            if (inputSources[i] != Detail::SourceRange{0, 0} &&
+                columns[i].size() < results.size()) {
+                return Error{.kind = Error::Kind::UnboundVariable, .invalidRange = inputSources[i]};
+            }
+        }
+
+        constexpr std::size_t kInlineStackSize = 8;
+
+        std::array<double, kInlineStackSize * kBlockSize> inlineStack;
+        std::vector<double> heapStack;
+        double* stack = inlineStack.data();
+        if (maxStackDepth > kInlineStackSize) {
+            heapStack.resize(maxStackDepth * kBlockSize);
+            stack = heapStack.data();
+        }
+
+        for (std::size_t begin = 0; begin < results.size(); begin += kBlockSize) {
+            const auto count = std::min(kBlockSize, results.size() - begin);
+            RunBlock(stack, columns, begin, count, results.data() + begin);
+        }
+
+        return std::nullopt;
+    }
+
+    std::size_t InputCount() const { return inputSources.size(); }
+
+  private:
+    friend std::variant<CompiledExpression, Error> Compile(const Spec& spec, std::string_view str);
+    friend struct JitExpression;
+    friend struct Detail::CppTranslation;
+
+    // rows evaluated by EvalColumns() in one pass over the program
+    static constexpr std::size_t kBlockSize = 64;
+
+    explicit CompiledExpression(Detail::Compilation&& compilation)
+        : instructions(std::move(compilation.instructions)),
+          sourceRanges(std::move(compilation.sourceRanges)),
+          maxStackDepth(compilation.maxStackDepth),
+          inputSources(std::move(compilation.inputSources)) {}
+
+    std::variant<double, Error> Run(double* stack, const double* inputs) const {
+        using Code = Detail::Instruction::Code;
+
+        double* top = stack;
+        for (std::size_t i = 0; i < instructions.size(); ++i) {
+            const auto& instruction = instructions[i];
+            switch (instruction.code) {
+                case Code::Push: *top++ = instruction.operand.constant; break;
+                case Code::Load: *top++ = inputs[instruction.operand.index]; break;
+                case Code::Duplicate:
+                    *top = top[-1];
+                    ++top;
+                    break;
+                case Code::Scale: top[-1] *= instruction.operand.constant; break;
+                case Code::Negate: top[-1] = -top[-1]; break;
+                case Code::CallUnary:
+                    top[-1] = Detail::ApplyCustom(*instruction.operand.unary, top[-1]);
+                    break;
+                case Code::CallUnaryBuiltin:
+                    top[-1] = Detail::ApplyBuiltin(instruction.operand.unaryBuiltin, top[-1]);
+                    break;
+                case Code::CallBinary:
+                case Code::CheckedCallBinary:
+                    --top;
+                    top[-1] = Detail::ApplyCustom(*instruction.operand.binary, top[-1], top[0]);
+                    break;
+                case Code::CallBinaryBuiltin:
+                case Code::CheckedCallBinaryBuiltin:
+                    --top;
+                    top[-1] =
+                        Detail::ApplyBuiltin(instruction.operand.binaryBuiltin, top[-1], top[0]);
+                    break;
+                case Code::Add:
+                    --top;
+                    top[-1] += top[0];
+                    break;
+                case Code::Subtract:
+                    --top;
+                    top[-1] -= top[0];
+                    break;
+                case Code::Multiply:
+                    --top;
+                    top[-1] *= top[0];
+                    break;
+                case Code::Divide:
+                    --top;
+                    top[-1] /= top[0];
+                    break;
+            }
+
+            if (instruction.IsChecked() && !std::isfinite(top[-1])) {
+                return Error{
+                    .kind = std::isnan(top[-1]) ? Error::Kind::NotANumber
+                                                : Error::Kind::InfiniteValue,
+                    .invalidRange = sourceRanges[i],
+                };
+            }
+        }
+
+        return stack[0];
+    }
+
+    void RunBlock(double* stack, std::span<const std::span<const double>> columns,
+                  std::size_t begin, std::size_t count, double* out) const {
+        using Code = Detail::Instruction::Code;
+        namespace Simd = Detail::Simd;
+
+        std::array<double, kBlockSize> poison;
+        Simd::Fill(poison.data(), 0., count);
+
+        // every entry of the stack is a block of kBlockSize values
+        std::size_t depth = 0;
+        const auto entry = [&](std::size_t fromTop) {
+            return stack + (depth - fromTop) * kBlockSize;
+        };
+
+        for (const auto& instruction : instructions) {
+            if (instruction.PopsOperand()) {
+                --depth;
+            }
+
+            switch (instruction.code) {
+                case Code::Push:
+                    Simd::Fill(entry(0), instruction.operand.constant, count);
+                    ++depth;
+                    break;
+                case Code::Load:
+                    std::memcpy(entry(0), columns[instruction.operand.index].data() + begin,
+                                count * sizeof(double));
+                    ++depth;
+                    break;
+                case Code::Duplicate:
+                    std::memcpy(entry(0), entry(1), count * sizeof(double));
+                    ++depth;
+                    break;
+                case Code::Scale:
+                    Simd::Transform(entry(1), entry(1), count,
+                                    Simd::ScaleOp{.multiplier = instruction.operand.constant});
+                    break;
+                case Code::Negate:
+                    Simd::Transform(entry(1), entry(1), count, Simd::NegateOp{});
+                    break;
+                case Code::CallUnary:
+                    for (double *value = entry(1), *end = value + count; value != end; ++value) {
+                        *value = Detail::ApplyCustom(*instruction.operand.unary, *value);
+                    }
+                    break;
+                case Code::CallUnaryBuiltin:
+                    for (double *value = entry(1), *end = value + count; value != end; ++value) {
+                        *value = Detail::ApplyBuiltin(instruction.operand.unaryBuiltin, *value);
+                    }
+                    break;
+                case Code::CallBinary:
+                case Code::CheckedCallBinary:
+                    for (std::size_t i = 0; i < count; ++i) {
+                        entry(1)[i] = Detail::ApplyCustom(*instruction.operand.binary,
+                                                          entry(1)[i], entry(0)[i]);
+                    }
+                    break;
+                case Code::CallBinaryBuiltin:
+                case Code::CheckedCallBinaryBuiltin:
+                    for (std::size_t i = 0; i < count; ++i) {
+                        entry(1)[i] = Detail::ApplyBuiltin(instruction.operand.binaryBuiltin,
+                                                           entry(1)[i], entry(0)[i]);
+                    }
+                    break;
+                case Code::Add:
+                    Simd::Transform(entry(1), entry(0), entry(1), count, Simd::AddOp{});
+                    break;
+                case Code::Subtract:
+                    Simd::Transform(entry(1), entry(0), entry(1), count, Simd::SubtractOp{});
+                    break;
+                case Code::Multiply:
+                    Simd::Transform(entry(1), entry(0), entry(1), count, Simd::MultiplyOp{});
+                    break;
+                case Code::Divide:
+                    Simd::Transform(entry(1), entry(0), entry(1), count, Simd::DivideOp{});
+                    break;
+            }
+
+            if (instruction.IsChecked()) {
+                Simd::Transform(entry(1), poison.data(), poison.data(), count,
+                                Simd::AccumulateNonFiniteOp{});
+            }
+        }
+
+        Simd::Transform(stack, poison.data(), out, count, Simd::ApplyPoisonOp{});
+    }
+
+    std::vector<Detail::Instruction> instructions;
+    std::vector<Detail::SourceRange> sourceRanges;
+    std::size_t maxStackDepth;
+
+    // the first use of each input, {0, 0} for the ones not used
+    std::vector<Detail::SourceRange> inputSources;
+};
+
+} // namespace Calc
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <functional>
 #include <optional>
 #include <string_view>
@@ -9,29 +10,96 @@
 
 namespace Calc {
 
+// Operations the interpreter computes itself, without calling through func. Custom ones call func.
+enum class UnaryBuiltin : std::uint8_t {
+    Custom,
+
+    Negate,
+    Abs,
+    Ceil,
+    Floor,
+    Round,
+
+    Exp,
+    Exp2,
+    Sqrt,
+    Ln,
+    Log2,
+    Log10,
+
+    Sin,
+    Cos,
+    Tan,
+    Asin,
+    Acos,
+    Atan,
+    Sinh,
+    Cosh,
+    Tanh,
+    Asinh,
+    Acosh,
+    Atanh,
+};
+
+enum class BinaryBuiltin : std::uint8_t {
+    Custom,
+
+    Add,
+    Subtract,
+    Multiply,
+    Divide,
+
+    Min,
+    Max,
+    Pow,
+};
+
 struct UnaryOp {
-    std::function<double(double)> func;
+    UnaryBuiltin builtin = UnaryBuiltin::Custom;
+    // only called for UnaryBuiltin::Custom
+    std::function<double(double)> func = {};
 
     bool keepsMeasure = true;
-    std::size_t precedence;
+    std::size_t precedence = 0;
 };
 
 struct BinaryOp {
-    std::function<double(double, double)> func;
+    BinaryBuiltin builtin = BinaryBuiltin::Custom;
+    // only called for BinaryBuiltin::Custom
+    std::function<double(double, double)> func = {};
 
     bool leftAssociative = true;
     bool keepsMeasure = true;
-    std::size_t precedence;
+    std::size_t precedence = 0;
 };
 
 struct Operator {
-    std::optional<UnaryOp> unary;
-    std::optional<BinaryOp> binary;
+    std::optional<UnaryOp> unary = std::nullopt;
+    std::optional<BinaryOp> binary = std::nullopt;
+};
+
+namespace Detail {
+
+template <class T>
+struct BuiltinOf;
+
+template <>
+struct BuiltinOf<double(double)> {
+    using type = UnaryBuiltin;
 };
 
+template <>
+struct BuiltinOf<double(double, double)> {
+    using type = BinaryBuiltin;
+};
+
+} // namespace Detail
+
 template <class T>
 struct Fun {
-    std::function<T> func;
+    typename Detail::BuiltinOf<T>::type builtin = {};
+    // only called for the Custom builtin
+    std::function<T> func = {};
 
     bool keepsMeasure = true;
 };
@@ -43,9 +111,23 @@ using Constant = double;
 
 struct Measure {
     std::size_t id = 0;
-    double multiplier;
+    double multiplier = 1.;
+};
+
+// A unit of a measure, see Spec::UnitsOf.
+struct Unit {
+    std::string_view name;
+    double multiplier = 1.;
+};
+
+// A value bound at evaluation time, inputs[index] of the evaluated inputs.
+struct Variable {
+    std::size_t index = 0;
+
+    // the 1-based index of the measure in SpecBuilder::measures, 0 if the value has no measure
+    std::size_t measureId = 0;
 };
 
-using Identifier = std::variant<UnaryFun, BinaryFun, Constant, Measure>;
+using Identifier = std::variant<UnaryFun, BinaryFun, Constant, Measure, Variable>;
 
 } // namespace Calc
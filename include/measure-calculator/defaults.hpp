@@ -1,93 +1,136 @@
 #pragma once
 
 #include "spec.hpp"
+#include "static-spec.hpp"
+
+#include <array>
+#include <string_view>
+#include <utility>
 
 namespace Calc {
 
+namespace Static {
+
 namespace Defaults {
 
-using Unary = double (*)(double);
-using Binary = double (*)(double, double);
+template <class T, std::size_t Size>
+using SpecArray = std::array<std::pair<std::string_view, T>, Size>;
 
-const SpecFor<UnaryOp> kNegateUnaryOp{
-    {"-", {.func = std::negate<double>{}, .precedence = 12}},
-};
+constexpr SpecArray<UnaryOp, 1> kNegateUnaryOp{{
+    {"-", {.builtin = UnaryBuiltin::Negate, .precedence = 12}},
+}};
 
-const SpecFor<BinaryOp> kArithmeticBinaryOps{
-    {"*", {.func = std::multiplies<double>{}, .precedence = 8}},
-    {"/", {.func = std::divides<double>{}, .precedence = 8}},
-    {"+", {.func = std::plus<double>{}, .precedence = 4}},
-    {"-", {.func = std::minus<double>{}, .precedence = 4}},
-};
+constexpr SpecArray<BinaryOp, 4> kArithmeticBinaryOps{{
+    {"*", {.builtin = BinaryBuiltin::Multiply, .precedence = 8}},
+    {"/", {.builtin = BinaryBuiltin::Divide, .precedence = 8}},
+    {"+", {.builtin = BinaryBuiltin::Add, .precedence = 4}},
+    {"-", {.builtin = BinaryBuiltin::Subtract, .precedence = 4}},
+}};
 
-const SpecFor<UnaryFun> kBasicUnaryFuns{
-    {"abs", UnaryFun{.func = Unary(std::abs)}},
+constexpr SpecArray<UnaryFun, 4> kBasicUnaryFuns{{
+    {"abs", {.builtin = UnaryBuiltin::Abs}},
 
-    {"ceil", UnaryFun{.func = Unary(std::ceil)}},
-    {"floor", UnaryFun{.func = Unary(std::floor)}},
-    {"round", UnaryFun{.func = Unary(std::round)}},
-};
+    {"ceil", {.builtin = UnaryBuiltin::Ceil}},
+    {"floor", {.builtin = UnaryBuiltin::Floor}},
+    {"round", {.builtin = UnaryBuiltin::Round}},
+}};
 
-const SpecFor<UnaryFun> kExponentialUnaryFuns{
-    {"exp", UnaryFun{.func = Unary(std::exp)}},     {"exp2", UnaryFun{.func = Unary(std::exp2)}},
-    {"sqrt", UnaryFun{.func = Unary(std::sqrt)}},
+constexpr SpecArray<UnaryFun, 6> kExponentialUnaryFuns{{
+    {"exp", {.builtin = UnaryBuiltin::Exp}},
+    {"exp2", {.builtin = UnaryBuiltin::Exp2}},
+    {"sqrt", {.builtin = UnaryBuiltin::Sqrt}},
 
-    {"ln", UnaryFun{.func = Unary(std::log)}},      {"log2", UnaryFun{.func = Unary(std::log2)}},
-    {"log10", UnaryFun{.func = Unary(std::log10)}},
-};
+    {"ln", {.builtin = UnaryBuiltin::Ln}},
+    {"log2", {.builtin = UnaryBuiltin::Log2}},
+    {"log10", {.builtin = UnaryBuiltin::Log10}},
+}};
 
-const SpecFor<UnaryFun> kTrigonometricUnaryFuns{
-    {"sin", UnaryFun{.func = Unary(std::sin), .keepsMeasure = false}},
-    {"cos", UnaryFun{.func = Unary(std::cos), .keepsMeasure = false}},
-    {"tan", UnaryFun{.func = Unary(std::tan), .keepsMeasure = false}},
+constexpr SpecArray<UnaryFun, 12> kTrigonometricUnaryFuns{{
+    {"sin", {.builtin = UnaryBuiltin::Sin, .keepsMeasure = false}},
+    {"cos", {.builtin = UnaryBuiltin::Cos, .keepsMeasure = false}},
+    {"tan", {.builtin = UnaryBuiltin::Tan, .keepsMeasure = false}},
 
-    {"asin", UnaryFun{.func = Unary(std::asin), .keepsMeasure = false}},
-    {"acos", UnaryFun{.func = Unary(std::acos), .keepsMeasure = false}},
-    {"atan", UnaryFun{.func = Unary(std::atan), .keepsMeasure = false}},
+    {"asin", {.builtin = UnaryBuiltin::Asin, .keepsMeasure = false}},
+    {"acos", {.builtin = UnaryBuiltin::Acos, .keepsMeasure = false}},
+    {"atan", {.builtin = UnaryBuiltin::Atan, .keepsMeasure = false}},
 
-    {"sinh", UnaryFun{.func = Unary(std::sinh), .keepsMeasure = false}},
-    {"cosh", UnaryFun{.func = Unary(std::cosh), .keepsMeasure = false}},
-    {"tanh", UnaryFun{.func = Unary(std::tanh), .keepsMeasure = false}},
+    {"sinh", {.builtin = UnaryBuiltin::Sinh, .keepsMeasure = false}},
+    {"cosh", {.builtin = UnaryBuiltin::Cosh, .keepsMeasure = false}},
+    {"tanh", {.builtin = UnaryBuiltin::Tanh, .keepsMeasure = false}},
 
-    {"asinh", UnaryFun{.func = Unary(std::asinh), .keepsMeasure = false}},
-    {"acosh", UnaryFun{.func = Unary(std::acosh), .keepsMeasure = false}},
-    {"atanh", UnaryFun{.func = Unary(std::atanh), .keepsMeasure = false}},
-};
+    {"asinh", {.builtin = UnaryBuiltin::Asinh, .keepsMeasure = false}},
+    {"acosh", {.builtin = UnaryBuiltin::Acosh, .keepsMeasure = false}},
+    {"atanh", {.builtin = UnaryBuiltin::Atanh, .keepsMeasure = false}},
+}};
 
-const SpecFor<BinaryFun> kBasicBinaryFuns{
-    {"min", BinaryFun{.func = Binary(std::fmin)}},
-    {"max", BinaryFun{.func = Binary(std::fmax)}},
+constexpr SpecArray<BinaryFun, 3> kBasicBinaryFuns{{
+    {"min", {.builtin = BinaryBuiltin::Min}},
+    {"max", {.builtin = BinaryBuiltin::Max}},
 
-    {"pow", BinaryFun{.func = Binary(std::pow)}},
-};
+    {"pow", {.builtin = BinaryBuiltin::Pow}},
+}};
 
 constexpr double pi = 3.14159265358979323846;
 constexpr double e = 2.71828182845904523536;
 
-const SpecFor<Constant> kBasicConstants{
+constexpr SpecArray<Constant, 2> kBasicConstants{{
     {"pi", pi},
     {"e", e},
-};
-
-const MeasureSpec kLinearMeasure{"length",
-                                 {
-                                     {"mm", 1e-3},
-                                     {"cm", 1e-2},
-                                     {"dm", 1e-1},
-                                     {"m", 1.},
-                                     {"km", 1e3},
-                                     {"ft", 0.3048},
-                                     {"in", 0.0254},
-                                 }};
-
-const MeasureSpec kAngularMeasure{"angular",
-                                  {{"turn", 2. * pi},
-                                   {"rad", 1.},
-                                   {"º", pi / 180.},
-                                   {"°", pi / 180.},
-                                   {"'", pi / (180. * 60.)},
-                                   {"''", pi / (180. * 60. * 60.)},
-                                   {"\"", pi / (180. * 60. * 60.)}}};
+}};
+
+constexpr std::array<std::pair<std::string_view, double>, 7> kLinearUnits{{
+    {"mm", 1e-3},
+    {"cm", 1e-2},
+    {"dm", 1e-1},
+    {"m", 1.},
+    {"km", 1e3},
+    {"ft", 0.3048},
+    {"in", 0.0254},
+}};
+
+constexpr MeasureSpec kLinearMeasure{"length", kLinearUnits};
+
+constexpr std::array<std::pair<std::string_view, double>, 7> kAngularUnits{{
+    {"turn", 2. * pi},
+    {"rad", 1.},
+    {"º", pi / 180.},
+    {"°", pi / 180.},
+    {"'", pi / (180. * 60.)},
+    {"''", pi / (180. * 60. * 60.)},
+    {"\"", pi / (180. * 60. * 60.)},
+}};
+
+constexpr MeasureSpec kAngularMeasure{"angular", kAngularUnits};
+
+} // namespace Defaults
+
+} // namespace Static
+
+namespace Defaults {
+
+const SpecFor<UnaryOp> kNegateUnaryOp = Static::ToSpecFor(Static::Defaults::kNegateUnaryOp);
+
+const SpecFor<BinaryOp> kArithmeticBinaryOps =
+    Static::ToSpecFor(Static::Defaults::kArithmeticBinaryOps);
+
+const SpecFor<UnaryFun> kBasicUnaryFuns = Static::ToSpecFor(Static::Defaults::kBasicUnaryFuns);
+
+const SpecFor<UnaryFun> kExponentialUnaryFuns =
+    Static::ToSpecFor(Static::Defaults::kExponentialUnaryFuns);
+
+const SpecFor<UnaryFun> kTrigonometricUnaryFuns =
+    Static::ToSpecFor(Static::Defaults::kTrigonometricUnaryFuns);
+
+const SpecFor<BinaryFun> kBasicBinaryFuns = Static::ToSpecFor(Static::Defaults::kBasicBinaryFuns);
+
+constexpr double pi = Static::Defaults::pi;
+constexpr double e = Static::Defaults::e;
+
+const SpecFor<Constant> kBasicConstants = Static::ToSpecFor(Static::Defaults::kBasicConstants);
+
+const MeasureSpec kLinearMeasure = Static::ToDynamic(Static::Defaults::kLinearMeasure);
+
+const MeasureSpec kAngularMeasure = Static::ToDynamic(Static::Defaults::kAngularMeasure);
 
 } // namespace Defaults
 
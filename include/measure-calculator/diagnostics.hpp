@@ -0,0 +1,111 @@
+#pragma once
+
+#include "builtins.hpp"
+#include "error.hpp"
+#include "interpreter.hpp"
+#include "spec.hpp"
+
+#include <cmath>
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <variant>
+
+namespace Calc {
+
+namespace Detail {
+
+// Backend of the Interpreter collecting every error instead of stopping at the first one. The
+// values are computed as by DirectEvaluation, to find the values which are not finite, but those
+// depending on an error are unknown and not checked.
+struct Diagnosis {
+    // nothing if unknown
+    using Value = std::optional<double>;
+
+    std::span<const double> inputs;
+    // the first errors found
+    std::span<Error> errors;
+    // every error found, even those not fitting into errors
+    std::size_t count = 0;
+    SourceRange lastRange = {0, 0};
+
+    void Report(const Error& error) {
+        // recovering may run into the same invalid part again, e.g. the token after a function
+        // name which is not a paren and which does not continue the expression either
+        if (count > 0 && error.invalidRange == lastRange) {
+            return;
+        }
+
+        if (count < errors.size()) {
+            errors[count] = error;
+        }
+        ++count;
+        lastRange = error.invalidRange;
+    }
+
+    Value Unknown() { return std::nullopt; }
+
+    Value Literal(double value) { return value; }
+
+    std::variant<Value, Error::Kind> Input(const Variable& variable, SourceRange) {
+        if (variable.index >= inputs.size()) {
+            return Error::Kind::UnboundVariable;
+        }
+
+        return inputs[variable.index];
+    }
+
+    Value Duplicate(Value value) { return value; }
+
+    Value Scale(Value value, double multiplier) {
+        return value ? Value(*value * multiplier) : std::nullopt;
+    }
+
+    Value UnaryOperator(const UnaryOpEntry& op, Value inner) {
+        return inner ? Value(Apply(op.call, *inner)) : std::nullopt;
+    }
+
+    std::variant<Value, Error::Kind> BinaryOperator(const BinaryOpEntry& op, Value left,
+                                                    Value right, SourceRange) {
+        if (!left || !right) {
+            return Value();
+        }
+
+        auto result = Apply(op.call, *left, *right);
+        if (std::isnan(result)) {
+            return Error::Kind::NotANumber;
+        }
+        if (std::isinf(result)) {
+            return Error::Kind::InfiniteValue;
+        }
+
+        return Value(result);
+    }
+
+    Value UnaryFunction(const UnaryFunEntry& fun, Value inner) {
+        return inner ? Value(Apply(fun.call, *inner)) : std::nullopt;
+    }
+
+    Value BinaryFunction(const BinaryFunEntry& fun, Value left, Value right) {
+        return left && right ? Value(Apply(fun.call, *left, *right)) : std::nullopt;
+    }
+};
+
+} // namespace Detail
+
+// Finds every error of the expression in a single pass, e.g. to underline them in an editor.
+// The first errors.size() of them are stored in errors, in the order they are found. Returns how
+// many errors there are, 0 if Evaluate() would succeed.
+// After an error the parsing goes on at the next paren, comma or operator, with an unknown value
+// where one is missing, so that the errors which only follow from an earlier one are left out.
+inline std::size_t Diagnose(const Spec& spec, std::string_view str, std::span<Error> errors,
+                            std::span<const double> inputs = {}) {
+    Detail::Interpreter<Detail::Diagnosis> parser(spec, str,
+                                                  {.inputs = inputs, .errors = errors});
+    parser.Parse();
+
+    return parser.backend.count;
+}
+
+} // namespace Calc
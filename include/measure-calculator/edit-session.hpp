@@ -0,0 +1,304 @@
+#pragma once
+
+#include "char-classification.hpp"
+#include "error.hpp"
+#include "interpreter.hpp"
+#include "lexer.hpp"
+#include "observer.hpp"
+#include "spec.hpp"
+#include "token.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+namespace Calc {
+
+namespace Detail {
+
+struct SessionToken {
+    std::size_t offset;
+    std::size_t length;
+
+    // the lexer looked at the characters before scanEnd to find this token, so edits from scanEnd
+    // on do not change it
+    std::size_t scanEnd;
+
+    TokenData::Any data;
+    // set for the last token if lexing failed
+    std::optional<Error> error;
+};
+
+// A parenthesized group parsed successfully, the measure location of its result is relative to
+// the offset of its '('.
+struct CachedGroup {
+    std::size_t closeIndex;
+    MeasuredValue result;
+    // how deep the group nests, counted from outside of it the way Spec::maxDepth is
+    std::size_t nesting;
+};
+
+// Replays the tokens of an EditSession for the Interpreter, in place of the Lexer.
+struct SessionTokens {
+    using Observer = EvaluationObserver;
+
+    std::string_view totalString;
+    std::span<const SessionToken> tokens;
+    // the groups opened by each token
+    std::span<std::optional<CachedGroup>> groups;
+
+    Token curr = {.str = "", .data = TokenData::Error{}};
+    std::size_t next = 0;
+
+    [[no_unique_address]] Observer observer = {};
+
+    std::size_t CurrentIndex() const { return next - 1; }
+
+    std::size_t CurrentEnd() const {
+        if (next > tokens.size()) {
+            return totalString.size();
+        }
+
+        return tokens[next - 1].offset + tokens[next - 1].length;
+    }
+
+    std::optional<Error> Step() {
+        if (next >= tokens.size()) {
+            next = tokens.size() + 1;
+            curr = {.str = "", .data = TokenData::Eof{}};
+            return std::nullopt;
+        }
+
+        const auto& token = tokens[next++];
+        curr = {.str = totalString.substr(token.offset, token.length), .data = token.data};
+        return token.error;
+    }
+
+    // The group opened by curr if it was parsed before and nests at most maxNesting deep, moving
+    // to its ')'. Deeper ones are parsed again, for the nesting limit to report them.
+    std::optional<CachedGroup> ReuseGroup(std::size_t maxNesting) {
+        const auto& group = groups[CurrentIndex()];
+        if (!group || group->nesting > maxNesting) {
+            return std::nullopt;
+        }
+
+        auto result = *group;
+        if (result.result.measure) {
+            const auto offset = tokens[CurrentIndex()].offset;
+            result.result.measure->sourceLocation.first += offset;
+            result.result.measure->sourceLocation.second += offset;
+        }
+
+        next = group->closeIndex;
+        Step();
+        return result;
+    }
+
+    // curr is right after the ')' of the group
+    void StoreGroup(std::size_t openIndex, const MeasuredValue& result, std::size_t nesting) {
+        auto& group = groups[openIndex];
+        group = CachedGroup{.closeIndex = CurrentIndex() - 1, .result = result, .nesting = nesting};
+        if (group->result.measure) {
+            const auto offset = tokens[openIndex].offset;
+            group->result.measure->sourceLocation.first -= offset;
+            group->result.measure->sourceLocation.second -= offset;
+        }
+    }
+};
+
+} // namespace Detail
+
+// An expression being edited, evaluated after every edit. Only the tokens around the edit are
+// lexed again, and the results of the parenthesized groups not touched by it are reused.
+// Refers to the Spec, so it must not outlive it.
+struct EditSession {
+    explicit EditSession(const Spec& spec, std::string_view text = {}) : spec(spec) {
+        Edit(0, 0, text);
+    }
+
+    // Replaces the removed characters from offset with inserted, and evaluates the new text.
+    // offset and removed are clamped to the text.
+    std::variant<double, Error> Edit(std::size_t offset, std::size_t removed,
+                                     std::string_view inserted) {
+        offset = std::min(offset, text.size());
+        removed = std::min(removed, text.size() - offset);
+        Relex(offset, removed, inserted);
+
+        Detail::Interpreter<Detail::DirectEvaluation, Detail::SessionTokens> interpreter(
+            spec, Detail::SessionTokens{.totalString = text, .tokens = tokens, .groups = groups},
+            {});
+        if (auto measuredValue = interpreter.Parse()) {
+            result = measuredValue->value;
+        } else {
+            result = interpreter.error.value();
+        }
+
+        return result;
+    }
+
+    std::variant<double, Error> Result() const { return result; }
+
+    std::string_view Text() const { return text; }
+
+  private:
+    using SessionToken = Detail::SessionToken;
+
+    std::size_t ScanEnd(std::size_t offset, std::size_t length,
+                        const Detail::TokenData::Any& data) const {
+        using namespace Detail;
+
+        const auto end = offset + length;
+        const auto runEnd = [&](bool (*continues)(char)) {
+            const auto found = std::find_if(text.begin() + end, text.end(),
+                                            [&](char c) { return !continues(c); });
+            return static_cast<std::size_t>(found - text.begin());
+        };
+
+        std::size_t scanEnd = text.size() + 1;
+        if (std::holds_alternative<TokenData::Value>(data)) {
+            // the exponent of a number is only taken when followed by digits
+            scanEnd = end + 3;
+        } else if (std::holds_alternative<TokenData::Operator>(data)) {
+            scanEnd = runEnd(IsOperatorChar) + 1;
+        } else if (std::holds_alternative<TokenData::OpenParen>(data) ||
+                   std::holds_alternative<TokenData::CloseParen>(data) ||
+                   std::holds_alternative<TokenData::Comma>(data)) {
+            scanEnd = end;
+        } else if (!std::holds_alternative<TokenData::Error>(data)) {
+            scanEnd = runEnd(IsIdentifierChar) + 1;
+        }
+
+        // nothing is lexed past whitespace (or the end)
+        return std::min(scanEnd, runEnd([](char c) { return !IsWhiteSpace(c); }) + 1);
+    }
+
+    void Relex(std::size_t offset, std::size_t removed, std::string_view inserted) {
+        const auto delta = static_cast<std::ptrdiff_t>(inserted.size()) -
+                           static_cast<std::ptrdiff_t>(removed);
+
+        // the tokens before first are lexed the same way after the edit
+        auto first = static_cast<std::size_t>(
+            std::lower_bound(tokens.begin(), tokens.end(), offset,
+                             [](const SessionToken& token, std::size_t value) {
+                                 return token.offset < value;
+                             }) -
+            tokens.begin());
+        for (auto i = first; i > 0; --i) {
+            if (tokens[i - 1].scanEnd > offset) {
+                first = i - 1;
+            }
+
+            // the tokens before whitespace do not look past it
+            if (i > 1 && tokens[i - 2].offset + tokens[i - 2].length != tokens[i - 1].offset) {
+                break;
+            }
+        }
+
+        // the tokens from resume on are lexed the same way too, once the lexer gets back to them
+        auto resume = static_cast<std::size_t>(
+            std::lower_bound(tokens.begin() + first, tokens.end(), offset + removed,
+                             [](const SessionToken& token, std::size_t value) {
+                                 return token.offset < value;
+                             }) -
+            tokens.begin());
+
+        text.replace(offset, removed, inserted);
+
+        const auto start = first > 0 ? tokens[first - 1].offset + tokens[first - 1].length : 0;
+        Detail::Lexer lexer{
+            .spec = spec,
+            .totalString = text,
+            .unanalyzed = std::string_view(text).substr(start),
+            .curr = {.str = "", .data = Detail::TokenData::Error{}},
+        };
+
+        std::vector<SessionToken> relexed;
+        while (true) {
+            lexer.EatWhitespace();
+            const auto position = lexer.CurrentEnd();
+            while (resume < tokens.size() &&
+                   static_cast<std::ptrdiff_t>(tokens[resume].offset) + delta <
+                       static_cast<std::ptrdiff_t>(position)) {
+                ++resume;
+            }
+            if (resume < tokens.size() &&
+                static_cast<std::ptrdiff_t>(tokens[resume].offset) + delta ==
+                    static_cast<std::ptrdiff_t>(position)) {
+                break;
+            }
+
+            auto error = lexer.Step();
+            if (std::holds_alternative<Detail::TokenData::Eof>(lexer.curr.data)) {
+                resume = tokens.size();
+                break;
+            }
+
+            if (error) {
+                // nothing is lexed after an error
+                relexed.push_back({
+                    .offset = error->invalidRange.first,
+                    .length = error->invalidRange.second - error->invalidRange.first,
+                    .scanEnd = text.size() + 1,
+                    .data = Detail::TokenData::Error{},
+                    .error = error,
+                });
+                resume = tokens.size();
+                break;
+            }
+
+            const auto length = lexer.curr.str.size();
+            relexed.push_back({
+                .offset = position,
+                .length = length,
+                .scanEnd = ScanEnd(position, length, lexer.curr.data),
+                .data = lexer.curr.data,
+                .error = std::nullopt,
+            });
+        }
+
+        // the groups are only valid if none of their tokens changed
+        for (std::size_t i = 0; i < first; ++i) {
+            if (groups[i] && groups[i]->closeIndex >= first) {
+                groups[i].reset();
+            }
+        }
+
+        const auto shift = [delta](std::size_t& position) {
+            position = static_cast<std::size_t>(static_cast<std::ptrdiff_t>(position) + delta);
+        };
+
+        const auto removedTokens = resume - first;
+        for (auto i = resume; i < tokens.size(); ++i) {
+            shift(tokens[i].offset);
+            shift(tokens[i].scanEnd);
+            if (tokens[i].error) {
+                shift(tokens[i].error->invalidRange.first);
+                shift(tokens[i].error->invalidRange.second);
+            }
+            if (groups[i]) {
+                groups[i]->closeIndex = groups[i]->closeIndex - removedTokens + relexed.size();
+            }
+        }
+
+        tokens.erase(tokens.begin() + first, tokens.begin() + resume);
+        tokens.insert(tokens.begin() + first, relexed.begin(), relexed.end());
+
+        groups.erase(groups.begin() + first, groups.begin() + resume);
+        groups.insert(groups.begin() + first, relexed.size(), std::nullopt);
+    }
+
+    const Spec& spec;
+
+    std::string text;
+    std::vector<SessionToken> tokens;
+    std::vector<std::optional<Detail::CachedGroup>> groups;
+
+    std::variant<double, Error> result = 0.;
+};
+
+} // namespace Calc
@@ -2,6 +2,7 @@
 
 #include <compare>
 #include <ostream>
+#include <string_view>
 #include <utility>
 
 namespace Calc {
@@ -26,6 +27,14 @@ struct Error {
         InfiniteValue,
 
         MeasureMismatch,
+
+        UnboundVariable,
+
+        // a unit to convert into is not in the Spec
+        UnknownUnit,
+
+        // nested deeper than Spec::maxDepth
+        NestingTooDeep,
     };
 
     Kind kind;
@@ -36,23 +45,31 @@ struct Error {
     std::strong_ordering operator<=>(const Error& other) const = default;
 };
 
-inline std::ostream& operator<<(std::ostream& os, const Error& error) {
-    switch (error.kind) {
-        case Error::Kind::UnclosedParen: os << "UnclosedParen"; break;
-        case Error::Kind::ConstantTooLarge: os << "ConstantTooLarge"; break;
-        case Error::Kind::ConstantTooSmall: os << "ConstantTooSmall"; break;
-        case Error::Kind::UnknownIdentifier: os << "UnknownIdentifier"; break;
-        case Error::Kind::UnknownOperator: os << "UnknownOperator"; break;
-        case Error::Kind::UnknownChar: os << "UnknownChar"; break;
-        case Error::Kind::UnexpectedEof: os << "UnexpectedEof"; break;
-        case Error::Kind::UnexpectedToken: os << "UnexpectedToken"; break;
-        case Error::Kind::ValueExpected: os << "ValueExpected"; break;
-        case Error::Kind::MeasureMismatch: os << "MeasureMismatch"; break;
-        case Error::Kind::NotANumber: os << "NotANumber"; break;
-        case Error::Kind::InfiniteValue: os << "InfiniteValue"; break;
-        case Error::Kind::DigitsExpected: os << "DigitsExpected"; break;
+inline std::string_view KindName(Error::Kind kind) {
+    switch (kind) {
+        case Error::Kind::UnclosedParen: return "UnclosedParen";
+        case Error::Kind::ConstantTooLarge: return "ConstantTooLarge";
+        case Error::Kind::ConstantTooSmall: return "ConstantTooSmall";
+        case Error::Kind::UnknownIdentifier: return "UnknownIdentifier";
+        case Error::Kind::UnknownOperator: return "UnknownOperator";
+        case Error::Kind::UnknownChar: return "UnknownChar";
+        case Error::Kind::UnexpectedEof: return "UnexpectedEof";
+        case Error::Kind::UnexpectedToken: return "UnexpectedToken";
+        case Error::Kind::ValueExpected: return "ValueExpected";
+        case Error::Kind::MeasureMismatch: return "MeasureMismatch";
+        case Error::Kind::NotANumber: return "NotANumber";
+        case Error::Kind::InfiniteValue: return "InfiniteValue";
+        case Error::Kind::DigitsExpected: return "DigitsExpected";
+        case Error::Kind::UnboundVariable: return "UnboundVariable";
+        case Error::Kind::UnknownUnit: return "UnknownUnit";
+        case Error::Kind::NestingTooDeep: return "NestingTooDeep";
     }
 
+    return "";
+}
+
+inline std::ostream& operator<<(std::ostream& os, const Error& error) {
+    os << KindName(error.kind);
     os << "{" << error.invalidRange.first << ", " << error.invalidRange.second << "}";
     os << " {" << error.secondaryInvalidRange.first << ", " << error.secondaryInvalidRange.second
        << "}";
@@ -1,9 +1,21 @@
 #pragma once
 
+#include "builtins.hpp"
 #include "lexer.hpp"
+#include "observer.hpp"
+#include "small-stack.hpp"
 #include "spec.hpp"
 
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <concepts>
+#include <cstdint>
 #include <optional>
+#include <span>
+#include <type_traits>
+#include <utility>
+#include <variant>
 
 namespace Calc {
 
@@ -12,40 +24,188 @@ struct MeasureData {
     std::size_t id;
 };
 
-struct MeasuredValue {
-    std::optional<MeasureData> measure;
-    double value;
+template <class Value>
+struct BasicMeasuredValue {
+    std::optional<MeasureData> measure = std::nullopt;
+    Value value;
 };
 
+using MeasuredValue = BasicMeasuredValue<double>;
+
 namespace Detail {
 
+using SourceRange = std::pair<std::size_t, std::size_t>;
+
+// Backend of the Interpreter computing the result right away.
+struct DirectEvaluation {
+    using Value = double;
+
+    std::span<const double> inputs;
+
+    Value Literal(double value) { return value; }
+
+    std::variant<Value, Error::Kind> Input(const Variable& variable, SourceRange) {
+        if (variable.index >= inputs.size()) {
+            return Error::Kind::UnboundVariable;
+        }
+
+        return inputs[variable.index];
+    }
+
+    Value Duplicate(Value value) { return value; }
+
+    Value Scale(Value value, double multiplier) { return value * multiplier; }
+
+    Value UnaryOperator(const UnaryOpEntry& op, Value inner) { return Apply(op.call, inner); }
+
+    std::variant<Value, Error::Kind> BinaryOperator(const BinaryOpEntry& op, Value left,
+                                                    Value right, SourceRange) {
+        auto result = Apply(op.call, left, right);
+        if (std::isnan(result)) {
+            return Error::Kind::NotANumber;
+        }
+        if (std::isinf(result)) {
+            return Error::Kind::InfiniteValue;
+        }
+
+        return result;
+    }
+
+    Value UnaryFunction(const UnaryFunEntry& fun, Value inner) { return Apply(fun.call, inner); }
+
+    Value BinaryFunction(const BinaryFunEntry& fun, Value left, Value right) {
+        return Apply(fun.call, left, right);
+    }
+};
+
+// Tokens is a BasicLexer, or anything else providing the same tokens the way the BasicLexer does.
+// The events of the interpreter go to the observer of Tokens too.
+template <class Backend = DirectEvaluation, class Tokens = Lexer>
 struct Interpreter {
-    Interpreter(const Spec& spec, std::string_view totalString)
-        : spec(spec),
-          lexer{
-              .spec = spec,
-              .totalString = totalString,
-              .unanalyzed = totalString,
-              .curr = {.str = "", .data = TokenData::Error{}},
-          } {
+    using Value = typename Backend::Value;
+    using Operand = BasicMeasuredValue<Value>;
+    using Observer = typename Tokens::Observer;
+
+    Interpreter(const Spec& spec, std::string_view totalString, Backend backend = {},
+                Observer observer = {})
+        requires std::is_same_v<Tokens, BasicLexer<Observer>>
+        : Interpreter(spec,
+                      Tokens{
+                          .spec = spec,
+                          .totalString = totalString,
+                          .unanalyzed = totalString,
+                          .curr = {.str = "", .data = TokenData::Error{}},
+                          .observer = std::move(observer),
+                      },
+                      std::move(backend)) {}
+
+    Interpreter(const Spec& spec, Tokens tokens, Backend backend)
+        : spec(spec), lexer(std::move(tokens)), backend(std::move(backend)) {
         Step();
     }
 
     const Spec& spec;
-    Lexer lexer;
-
+    Tokens lexer;
+    Backend backend;
+
+    // Tokens may keep the results of parenthesized groups, to skip them when parsed again
+    // along with how deep they nest
+    static constexpr bool kReusesGroups = requires(Tokens& tokens, const Operand& operand) {
+        { tokens.ReuseGroup(std::size_t{})->result } -> std::convertible_to<Operand>;
+        { tokens.ReuseGroup(std::size_t{})->nesting } -> std::convertible_to<std::size_t>;
+        tokens.StoreGroup(std::size_t{}, operand, std::size_t{});
+    };
+
+    // Backends collecting every error make the interpreter recover from them: each error is
+    // reported to the backend, the tokens it cannot parse are skipped, and it goes on with an
+    // unknown value where one is missing.
+    static constexpr bool kRecovers = requires(Backend& backend, const Error& error) {
+        backend.Report(error);
+        { backend.Unknown() } -> std::same_as<Value>;
+    };
+
+    // the first error
     std::optional<Error> error;
 
     void OnError(Error newError) {
+        if constexpr (kRecovers) {
+            backend.Report(newError);
+        }
+
         if (error) {
             return;
         }
 
         error = newError;
+        lexer.observer.OnError(newError);
+    }
+
+    // the result of call(), timing it if calls are observed
+    template <class Call>
+    auto ObserveCall(CallKind kind, std::string_view name, Call&& call) {
+        if constexpr (kObservesCalls<Observer>) {
+            const auto start = std::chrono::steady_clock::now();
+            auto result = call();
+            lexer.observer.OnCall(kind, name,
+                                  std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                      std::chrono::steady_clock::now() - start));
+            return result;
+        } else {
+            return call();
+        }
+    }
+
+    // what parsing goes on with after an error: an unknown value if recovering, nothing otherwise
+    std::optional<Operand> Recovered(std::optional<MeasureData> measure = std::nullopt) {
+        if constexpr (kRecovers) {
+            return Operand{.measure = measure, .value = backend.Unknown()};
+        } else {
+            return std::nullopt;
+        }
+    }
+
+    bool StartsValue() const {
+        if (auto* op = std::get_if<TokenData::Operator>(&lexer.curr.data)) {
+            return (*op)->unary.has_value();
+        }
+
+        return std::visit(
+            [](const auto& data) {
+                using Data = std::decay_t<decltype(data)>;
+                return std::is_same_v<Data, TokenData::Value> ||
+                       std::is_same_v<Data, TokenData::Constant> ||
+                       std::is_same_v<Data, TokenData::Variable> ||
+                       std::is_same_v<Data, TokenData::OpenParen> ||
+                       std::is_same_v<Data, TokenData::UnaryFun> ||
+                       std::is_same_v<Data, TokenData::BinaryFun>;
+            },
+            lexer.curr.data);
+    }
+
+    // skips the rest of the parenthesized group being parsed, with its closing paren
+    void SkipGroup() {
+        std::size_t nested = 0;
+        while (!std::holds_alternative<TokenData::Eof>(lexer.curr.data)) {
+            if (std::holds_alternative<TokenData::OpenParen>(lexer.curr.data)) {
+                ++nested;
+            } else if (std::holds_alternative<TokenData::CloseParen>(lexer.curr.data)) {
+                if (nested == 0) {
+                    Step();
+                    return;
+                }
+                --nested;
+            }
+            Step();
+        }
     }
 
     void ErrorCurrentToken(Error::Kind kind) {
-        const auto currentEnd = lexer.totalString.size() - lexer.unanalyzed.size();
+        if (std::holds_alternative<TokenData::Error>(lexer.curr.data)) {
+            // reported by the lexer already
+            return;
+        }
+
+        const auto currentEnd = lexer.CurrentEnd();
         const auto currentStart = currentEnd - lexer.curr.str.size();
         OnError({kind, {currentStart, currentEnd}});
     }
@@ -53,6 +213,9 @@ struct Interpreter {
     void Step() {
         if (auto newError = lexer.Step()) {
             OnError(*newError);
+            if constexpr (kRecovers) {
+                lexer.SkipInvalid(*newError);
+            }
         }
     }
 
@@ -80,8 +243,7 @@ struct Interpreter {
     struct NoMeasure {};
 
     std::variant<MeasureData, AnyMeasure, NoMeasure>
-    ResolveMeasure(const std::optional<MeasuredValue>& left,
-                   const std::optional<MeasuredValue>& right) {
+    ResolveMeasure(const std::optional<Operand>& left, const std::optional<Operand>& right) {
         if (left->measure || right->measure) {
             if (left->measure && right->measure) {
                 if (left->measure->id != right->measure->id) {
@@ -99,224 +261,514 @@ struct Interpreter {
         return AnyMeasure{};
     }
 
-    std::optional<MeasuredValue> ParseUnaryOperator(const UnaryOp& opSpec) {
-        Step();
-        auto inner = ParseExpression(opSpec.precedence);
-        if (!inner) {
-            return std::nullopt;
-        }
-
-        return MeasuredValue{
-            .measure = opSpec.keepsMeasure ? inner->measure : std::nullopt,
-            .value = opSpec.func(inner->value),
+    // What is left to do with the value of an expression being parsed: the parser keeps a stack
+    // of them instead of recursing, so that the nesting of the input only takes heap memory, and
+    // only as much as Spec::maxDepth allows.
+    struct Frame {
+        enum class Kind : std::uint8_t {
+            // the operators of an expression, whose operators have at least precedence
+            Operators,
+            Group,
+            UnaryOperator,
+            UnaryFunction,
+            // parsing the first argument
+            BinaryFunctionLeft,
+            // parsing the second argument, the first one is operand
+            BinaryFunctionRight,
         };
-    }
 
-    std::optional<MeasuredValue> ParseStandaloneValue() {
-        std::optional<MeasuredValue> result;
-        if (auto* value = std::get_if<TokenData::Value>(&lexer.curr.data)) {
-            result = MeasuredValue{.value = *value};
-            Step();
-            return result;
-        }
-
-        if (auto* constant = std::get_if<TokenData::Constant>(&lexer.curr.data)) {
-            result = MeasuredValue{.value = **constant};
-            Step();
-            return result;
-        }
-
-        if (std::holds_alternative<TokenData::OpenParen>(lexer.curr.data)) {
-            Step();
-            auto inner = ParseExpression();
-            if (!inner || !Expect<TokenData::CloseParen>()) {
-                return std::nullopt;
+        Kind kind = Kind::Operators;
+        std::size_t precedence = 0;
+        // of the open paren of a Group
+        std::size_t openIndex = 0;
+        // the depth a Group is opened at, the deepest one reached before it, and once it is
+        // closed, how deep it nests
+        std::size_t openDepth = 0;
+        std::size_t outerDeepest = 0;
+        std::size_t nesting = 0;
+
+        // the value of the operators so far, or the first argument of a BinaryFunctionRight
+        std::optional<Operand> operand = std::nullopt;
+        // the operator whose right operand is being parsed, and where it is
+        const BinaryOpEntry* binary = nullptr;
+        SourceRange binaryRange = {0, 0};
+
+        // the name of the unary operator or function being applied
+        std::string_view name = {};
+        const UnaryOpEntry* unaryOp = nullptr;
+        const UnaryFunEntry* unaryFun = nullptr;
+        const BinaryFunEntry* binaryFun = nullptr;
+    };
+
+    // frames of shallow expressions do not allocate
+    static constexpr std::size_t kInlineFrames = 16;
+
+    // what the parser does next in ParseExpression()
+    enum class Phase {
+        // parse a value, without its measure
+        Value,
+        // the value is parsed, parse its measure
+        Measure,
+        // the value is an operand of the Operators on top of the stack
+        Operators,
+        // the value is the result of the Operators popped from the stack
+        Return,
+    };
+
+    // The expression starting at the current token, of the operators with at least
+    // parentPrecedence. If rootValue is given, it is the first operand, parsed already.
+    std::optional<Operand> ParseExpression(std::size_t parentPrecedence = 0,
+                                           std::optional<Operand> rootValue = std::nullopt) {
+        SmallStack<Frame, kInlineFrames> frames;
+        // how many Operators are on the stack
+        std::size_t depth = 0;
+        // the most there were since the innermost Group was opened, to know how deep it nests
+        std::size_t deepest = 0;
+
+        const auto pushOperators = [&](std::size_t precedence) {
+            frames.push_back({.kind = Frame::Kind::Operators, .precedence = precedence});
+            ++depth;
+            deepest = std::max(deepest, depth);
+            if constexpr (kObservesDepth<Observer>) {
+                lexer.observer.OnDepth(depth);
             }
 
-            return inner;
-        }
-
-        if (auto* op = std::get_if<TokenData::Operator>(&lexer.curr.data)) {
-            if ((*op)->unary) {
-                return ParseUnaryOperator(*(*op)->unary);
-            }
-        }
-
-        if (auto* unaryFun = std::get_if<TokenData::UnaryFun>(&lexer.curr.data)) {
-            const auto& funSpec = **unaryFun;
-            Step();
-            if (!Expect<TokenData::OpenParen>()) {
-                return std::nullopt;
-            }
-
-            auto inner = ParseExpression();
-            if (!inner) {
-                return std::nullopt;
+            if (depth <= spec.maxDepth) {
+                return true;
             }
 
-            if (!Expect<TokenData::CloseParen>()) {
-                return std::nullopt;
+            ErrorCurrentToken(Error::Kind::NestingTooDeep);
+            if constexpr (kRecovers) {
+                // the rest would be too deep as well
+                while (!std::holds_alternative<TokenData::Eof>(lexer.curr.data)) {
+                    Step();
+                }
             }
+            return false;
+        };
 
-            return MeasuredValue{
-                .measure = funSpec.keepsMeasure ? inner->measure : std::nullopt,
-                .value = funSpec.func(inner->value),
-            };
+        if (!pushOperators(parentPrecedence)) {
+            return std::nullopt;
         }
 
-        if (auto* binaryFun = std::get_if<TokenData::BinaryFun>(&lexer.curr.data)) {
-            const auto& funSpec = **binaryFun;
-            Step();
-            if (!Expect<TokenData::OpenParen>()) {
-                return std::nullopt;
-            }
-
-            auto left = ParseExpression();
-            if (!left) {
-                return std::nullopt;
-            }
+        std::optional<Operand> value = std::move(rootValue);
+        auto phase = value ? Phase::Operators : Phase::Value;
+        while (true) {
+            switch (phase) {
+                case Phase::Value: {
+                    if (auto* literal = std::get_if<TokenData::Value>(&lexer.curr.data)) {
+                        value = Operand{.value = backend.Literal(*literal)};
+                        Step();
+                        phase = Phase::Measure;
+                        break;
+                    }
+
+                    if (auto* constant = std::get_if<TokenData::Constant>(&lexer.curr.data)) {
+                        value = Operand{.value = backend.Literal(**constant)};
+                        Step();
+                        phase = Phase::Measure;
+                        break;
+                    }
+
+                    if (auto* variable = std::get_if<TokenData::Variable>(&lexer.curr.data)) {
+                        value = ParseVariable(**variable);
+                        if (!value) {
+                            return std::nullopt;
+                        }
+                        phase = Phase::Measure;
+                        break;
+                    }
+
+                    if (std::holds_alternative<TokenData::OpenParen>(lexer.curr.data)) {
+                        std::size_t openIndex = 0;
+                        if constexpr (kReusesGroups) {
+                            if (auto reused = lexer.ReuseGroup(spec.maxDepth - depth)) {
+                                Step();
+                                deepest = std::max(deepest, depth + reused->nesting);
+                                value = std::move(reused->result);
+                                phase = Phase::Measure;
+                                break;
+                            }
+                            openIndex = lexer.CurrentIndex();
+                        }
+
+                        Step();
+                        frames.push_back({
+                            .kind = Frame::Kind::Group,
+                            .openIndex = openIndex,
+                            .openDepth = depth,
+                            .outerDeepest = deepest,
+                        });
+                        deepest = depth;
+                        if (!pushOperators(0)) {
+                            return std::nullopt;
+                        }
+                        break;
+                    }
+
+                    if (auto* op = std::get_if<TokenData::Operator>(&lexer.curr.data);
+                        op && (*op)->unary) {
+                        const auto& opSpec = *(*op)->unary;
+                        frames.push_back({
+                            .kind = Frame::Kind::UnaryOperator,
+                            .name = lexer.curr.str,
+                            .unaryOp = &opSpec,
+                        });
+                        Step();
+                        if (!pushOperators(opSpec.precedence)) {
+                            return std::nullopt;
+                        }
+                        break;
+                    }
+
+                    if (auto* unaryFun = std::get_if<TokenData::UnaryFun>(&lexer.curr.data)) {
+                        const auto* funSpec = *unaryFun;
+                        const auto name = lexer.curr.str;
+                        Step();
+                        if (!Expect<TokenData::OpenParen>()) {
+                            value = Recovered();
+                            if (!value) {
+                                return std::nullopt;
+                            }
+                            phase = Phase::Measure;
+                            break;
+                        }
+
+                        frames.push_back({
+                            .kind = Frame::Kind::UnaryFunction,
+                            .name = name,
+                            .unaryFun = funSpec,
+                        });
+                        if (!pushOperators(0)) {
+                            return std::nullopt;
+                        }
+                        break;
+                    }
+
+                    if (auto* binaryFun = std::get_if<TokenData::BinaryFun>(&lexer.curr.data)) {
+                        const auto* funSpec = *binaryFun;
+                        const auto name = lexer.curr.str;
+                        Step();
+                        if (!Expect<TokenData::OpenParen>()) {
+                            value = Recovered();
+                            if (!value) {
+                                return std::nullopt;
+                            }
+                            phase = Phase::Measure;
+                            break;
+                        }
+
+                        frames.push_back({
+                            .kind = Frame::Kind::BinaryFunctionLeft,
+                            .name = name,
+                            .binaryFun = funSpec,
+                        });
+                        if (!pushOperators(0)) {
+                            return std::nullopt;
+                        }
+                        break;
+                    }
+
+                    ErrorCurrentToken(Error::Kind::ValueExpected);
+                    if constexpr (kRecovers) {
+                        // the tokens which can follow a value are left to the frames
+                        const auto* op = std::get_if<TokenData::Operator>(&lexer.curr.data);
+                        if (!(op && (*op)->binary) &&
+                            !std::holds_alternative<TokenData::CloseParen>(lexer.curr.data) &&
+                            !std::holds_alternative<TokenData::Comma>(lexer.curr.data) &&
+                            !std::holds_alternative<TokenData::Eof>(lexer.curr.data)) {
+                            Step();
+                        }
+                    }
+                    value = Recovered();
+                    if (!value) {
+                        return std::nullopt;
+                    }
+                    phase = Phase::Measure;
+                    break;
+                }
 
-            Expect<TokenData::Comma>();
+                case Phase::Measure: {
+                    if (!ParseMeasure(*value)) {
+                        return std::nullopt;
+                    }
+                    phase = Phase::Operators;
+                    break;
+                }
 
-            auto right = ParseExpression();
-            if (!right) {
-                return std::nullopt;
-            }
+                case Phase::Operators: {
+                    auto& frame = frames.back();
+                    if (frame.binary) {
+                        if (!ApplyBinaryOperator(frame, *value)) {
+                            return std::nullopt;
+                        }
+                    } else {
+                        frame.operand = std::move(value);
+                    }
+
+                    const auto* op = std::get_if<TokenData::Operator>(&lexer.curr.data);
+                    const auto* binary = op && (*op)->binary ? &*(*op)->binary : nullptr;
+                    if (!binary || binary->precedence < frame.precedence) {
+                        value = std::move(frame.operand);
+                        frames.pop_back();
+                        --depth;
+                        phase = Phase::Return;
+                        break;
+                    }
+
+                    const auto binaryEnd = lexer.CurrentEnd();
+                    frame.binary = binary;
+                    frame.binaryRange = {binaryEnd - lexer.curr.str.size(), binaryEnd};
+                    Step();
+
+                    if (spec.usePostfixShorthand &&
+                        std::holds_alternative<TokenData::Eof>(lexer.curr.data)) {
+                        value = Operand{
+                            .measure = frame.operand->measure,
+                            .value = backend.Duplicate(frame.operand->value),
+                        };
+                        break;
+                    }
+
+                    const auto rightPrecedence =
+                        binary->leftAssociative ? binary->precedence + 1 : binary->precedence;
+                    if (!pushOperators(rightPrecedence)) {
+                        return std::nullopt;
+                    }
+                    phase = Phase::Value;
+                    break;
+                }
 
-            if (!Expect<TokenData::CloseParen>()) {
-                return std::nullopt;
+                case Phase::Return: {
+                    if (frames.empty()) {
+                        return value;
+                    }
+
+                    auto& frame = frames.back();
+                    if (frame.kind == Frame::Kind::Operators) {
+                        phase = Phase::Operators;
+                        break;
+                    }
+
+                    if (frame.kind == Frame::Kind::BinaryFunctionLeft) {
+                        frame.kind = Frame::Kind::BinaryFunctionRight;
+                        frame.operand = std::move(value);
+                        if (Expect<TokenData::Comma>() || !kRecovers ||
+                            !std::holds_alternative<TokenData::CloseParen>(lexer.curr.data)) {
+                            if (!pushOperators(0)) {
+                                return std::nullopt;
+                            }
+                            phase = Phase::Value;
+                        } else {
+                            // the missing second argument is reported already
+                            value = Recovered();
+                        }
+                        break;
+                    }
+
+                    if (frame.kind == Frame::Kind::Group) {
+                        frame.nesting = deepest - frame.openDepth;
+                        deepest = std::max(deepest, frame.outerDeepest);
+                    }
+                    value = Finish(frame, *value);
+                    if (!value) {
+                        return std::nullopt;
+                    }
+                    frames.pop_back();
+                    phase = Phase::Measure;
+                    break;
+                }
             }
+        }
+    }
 
-            std::optional<MeasureData> commonMeasure;
-            if (funSpec.keepsMeasure) {
-                auto measure = ResolveMeasure(left, right);
-                if (std::holds_alternative<NoMeasure>(measure)) {
-                    OnError({
-                        .kind = Error::Kind::MeasureMismatch,
-                        .invalidRange = right->measure->sourceLocation,
-                        .secondaryInvalidRange = left->measure->sourceLocation,
-                    });
-                    return std::nullopt;
-                }
+    std::optional<Operand> ParseVariable(const Variable& variable) {
+        const auto variableEnd = lexer.CurrentEnd();
+        const SourceRange variableRange{variableEnd - lexer.curr.str.size(), variableEnd};
 
-                if (auto specific = std::get_if<MeasureData>(&measure)) {
-                    commonMeasure = *specific;
-                }
+        auto value = backend.Input(variable, variableRange);
+        if (auto* kind = std::get_if<Error::Kind>(&value)) {
+            OnError({.kind = *kind, .invalidRange = variableRange});
+            if constexpr (kRecovers) {
+                Step();
             }
+            return Recovered();
+        }
 
-            return MeasuredValue{
-                .measure = commonMeasure,
-                .value = funSpec.func(left->value, right->value),
+        Operand result{.value = std::get<Value>(value)};
+        if (variable.measureId != 0) {
+            result.measure = MeasureData{
+                .sourceLocation = variableRange,
+                .id = variable.measureId,
             };
         }
-
-        ErrorCurrentToken(Error::Kind::ValueExpected);
-        return std::nullopt;
+        Step();
+        return result;
     }
 
-    std::optional<MeasuredValue> ParseValueWithMeasure() {
-        auto standaloneValue = ParseStandaloneValue();
-        if (!standaloneValue) {
-            return std::nullopt;
+    // the measure after value, if there is one
+    bool ParseMeasure(Operand& value) {
+        auto* measure = std::get_if<TokenData::Measure>(&lexer.curr.data);
+        if (!measure) {
+            return true;
         }
 
-        if (auto* measure = std::get_if<TokenData::Measure>(&lexer.curr.data)) {
-            const auto measure_end = lexer.totalString.size() - lexer.unanalyzed.size();
-            const auto measure_start = measure_end - lexer.curr.str.size();
-            const auto& measure_data = **measure;
-            if (standaloneValue->measure) {
-                if (standaloneValue->measure->id != measure_data.id) {
-                    OnError({
-                        .kind = Error::Kind::MeasureMismatch,
-                        .invalidRange = {measure_end - lexer.curr.str.size(), measure_end},
-                        .secondaryInvalidRange = {standaloneValue->measure->sourceLocation},
-                    });
-
-                    return std::nullopt;
-                }
-            } else {
-                Step();
-                standaloneValue->measure =
-                    MeasureData{
-                        .sourceLocation = {measure_start, measure_end},
-                        .id = measure_data.id,
-                    };
-                standaloneValue->value *= measure_data.multiplier;
-            }
+        const auto measureEnd = lexer.CurrentEnd();
+        const auto measureStart = measureEnd - lexer.curr.str.size();
+        const auto& measureData = **measure;
+        if (!value.measure) {
+            Step();
+            value.measure = MeasureData{
+                .sourceLocation = {measureStart, measureEnd},
+                .id = measureData.id,
+            };
+            value.value = backend.Scale(value.value, measureData.multiplier);
+            return true;
         }
 
-        return standaloneValue;
-    }
+        if (value.measure->id == measureData.id) {
+            return true;
+        }
 
-    std::optional<MeasuredValue> ParseExpression(std::size_t parentPrecedence = 0) {
-        auto rootValue = ParseValueWithMeasure();
-        if (!rootValue) {
-            return std::nullopt;
+        OnError({
+            .kind = Error::Kind::MeasureMismatch,
+            .invalidRange = {measureStart, measureEnd},
+            .secondaryInvalidRange = {value.measure->sourceLocation},
+        });
+        if constexpr (kRecovers) {
+            Step();
+            value = *Recovered(value.measure);
+            return true;
         }
+        return false;
+    }
 
-        while (std::holds_alternative<TokenData::Operator>(lexer.curr.data)) {
-            const auto& binary = std::get<TokenData::Operator>(lexer.curr.data)->binary;
-            if (!binary) {
-                break;
-            }
+    // applies the binary operator of the Operators frame to its operand and right
+    bool ApplyBinaryOperator(Frame& frame, const Operand& right) {
+        const auto& binary = *std::exchange(frame.binary, nullptr);
+        const auto [binaryStart, binaryEnd] = frame.binaryRange;
 
-            auto binaryEnd = lexer.totalString.size() - lexer.unanalyzed.size();
-            auto binaryStart = binaryEnd - lexer.curr.str.size();
-            if (binary->precedence < parentPrecedence) {
-                break;
-            }
+        std::optional<MeasureData> commonMeasure;
+        auto measure = ResolveMeasure(frame.operand, right);
+        if (std::holds_alternative<NoMeasure>(measure)) {
+            OnError({
+                .kind = Error::Kind::MeasureMismatch,
+                .invalidRange = right.measure->sourceLocation,
+                .secondaryInvalidRange = frame.operand->measure->sourceLocation,
+            });
+            // goes on without a measure, so that it is not reported again
+            frame.operand = Recovered();
+            return frame.operand.has_value();
+        }
 
-            const auto rightPrec =
-                binary->leftAssociative ? binary->precedence + 1 : binary->precedence;
+        if (auto specific = std::get_if<MeasureData>(&measure)) {
+            commonMeasure = *specific;
+        }
 
-            Step();
-            std::optional<MeasuredValue> right;
+        auto result = ObserveCall(
+            CallKind::BinaryOperator,
+            lexer.totalString.substr(binaryStart, binaryEnd - binaryStart), [&] {
+                return backend.BinaryOperator(binary, frame.operand->value, right.value,
+                                              {binaryStart, binaryEnd});
+            });
+        if (auto* kind = std::get_if<Error::Kind>(&result)) {
+            OnError({.kind = *kind, .invalidRange = {binaryStart, binaryEnd}});
+            frame.operand = Recovered(commonMeasure);
+            return frame.operand.has_value();
+        }
 
-            if (spec.usePostfixShorthand &&
-                std::holds_alternative<TokenData::Eof>(lexer.curr.data)) {
-                right = rootValue;
-            } else {
-                right = ParseExpression(rightPrec);
-            }
+        frame.operand = Operand{
+            .measure = commonMeasure,
+            .value = std::get<Value>(result),
+        };
+        return true;
+    }
 
-            if (!right) {
-                return std::nullopt;
-            }
+    // the value of the group, operator or function of frame, whose (last) operand is inner
+    std::optional<Operand> Finish(const Frame& frame, const Operand& inner) {
+        switch (frame.kind) {
+            case Frame::Kind::Group:
+                if (!Expect<TokenData::CloseParen>()) {
+                    if constexpr (kRecovers) {
+                        SkipGroup();
+                    }
+                    return Recovered(inner.measure);
+                }
 
-            std::optional<MeasureData> commonMeasure;
-            auto measure = ResolveMeasure(rootValue, right);
-            if (std::holds_alternative<NoMeasure>(measure)) {
-                OnError({
-                    .kind = Error::Kind::MeasureMismatch,
-                    .invalidRange = right->measure->sourceLocation,
-                    .secondaryInvalidRange = rootValue->measure->sourceLocation,
-                });
-                return std::nullopt;
-            }
+                if constexpr (kReusesGroups) {
+                    // after an error the result may not be what parsing the group alone gives
+                    if (!error) {
+                        lexer.StoreGroup(frame.openIndex, inner, frame.nesting);
+                    }
+                }
+                return inner;
+
+            case Frame::Kind::UnaryOperator:
+                return Operand{
+                    .measure = frame.unaryOp->keepsMeasure ? inner.measure : std::nullopt,
+                    .value = ObserveCall(CallKind::UnaryOperator, frame.name, [&] {
+                        return backend.UnaryOperator(*frame.unaryOp, inner.value);
+                    }),
+                };
+
+            case Frame::Kind::UnaryFunction:
+                if (!Expect<TokenData::CloseParen>()) {
+                    if constexpr (kRecovers) {
+                        SkipGroup();
+                    }
+                    return Recovered();
+                }
 
-            if (auto specific = std::get_if<MeasureData>(&measure)) {
-                commonMeasure = *specific;
-            }
+                return Operand{
+                    .measure = frame.unaryFun->keepsMeasure ? inner.measure : std::nullopt,
+                    .value = ObserveCall(CallKind::UnaryFunction, frame.name, [&] {
+                        return backend.UnaryFunction(*frame.unaryFun, inner.value);
+                    }),
+                };
+
+            case Frame::Kind::BinaryFunctionRight: {
+                if (!Expect<TokenData::CloseParen>()) {
+                    if constexpr (kRecovers) {
+                        SkipGroup();
+                    }
+                    return Recovered();
+                }
 
-            auto result = binary->func(rootValue->value, right->value);
-            bool isNan = std::isnan(result);
-            bool isInf = std::isinf(result);
-            if (isNan || isInf) {
-                OnError({.kind = isNan ? Error::Kind::NotANumber : Error::Kind::InfiniteValue,
-                         .invalidRange = {binaryStart, binaryEnd}});
-                return std::nullopt;
+                const auto& left = frame.operand;
+                std::optional<MeasureData> commonMeasure;
+                if (frame.binaryFun->keepsMeasure) {
+                    auto measure = ResolveMeasure(left, inner);
+                    if (std::holds_alternative<NoMeasure>(measure)) {
+                        OnError({
+                            .kind = Error::Kind::MeasureMismatch,
+                            .invalidRange = inner.measure->sourceLocation,
+                            .secondaryInvalidRange = left->measure->sourceLocation,
+                        });
+                        return Recovered();
+                    }
+
+                    if (auto specific = std::get_if<MeasureData>(&measure)) {
+                        commonMeasure = *specific;
+                    }
+                }
+
+                return Operand{
+                    .measure = commonMeasure,
+                    .value = ObserveCall(CallKind::BinaryFunction, frame.name, [&] {
+                        return backend.BinaryFunction(*frame.binaryFun, left->value,
+                                                      inner.value);
+                    }),
+                };
             }
 
-            rootValue = MeasuredValue{
-                .measure = commonMeasure,
-                .value = result,
-            };
+            case Frame::Kind::Operators:
+            case Frame::Kind::BinaryFunctionLeft: break;
         }
 
-        return rootValue;
+        return std::nullopt;
     }
 
-    std::optional<MeasuredValue> Parse() {
+    std::optional<Operand> Parse() {
         auto result = ParseExpression();
         if (!result) {
             return std::nullopt;
@@ -326,6 +778,27 @@ struct Interpreter {
             return result;
         }
 
+        if constexpr (kRecovers) {
+            // the rest is parsed for its errors only
+            while (!std::holds_alternative<TokenData::Eof>(lexer.curr.data)) {
+                ErrorCurrentToken(Error::Kind::UnexpectedToken);
+                if (StartsValue()) {
+                    ParseExpression();
+                    continue;
+                }
+
+                // goes on as if the unexpected token was not there
+                Step();
+                if (auto* op = std::get_if<TokenData::Operator>(&lexer.curr.data);
+                    op && (*op)->binary) {
+                    ParseExpression(0, Recovered());
+                } else if (StartsValue()) {
+                    ParseExpression();
+                }
+            }
+            return std::nullopt;
+        }
+
         ErrorCurrentToken(Error::Kind::UnexpectedToken);
         return std::nullopt;
     }
@@ -0,0 +1,390 @@
+#pragma once
+
+#include "builtins.hpp"
+#include "compiled-expression.hpp"
+#include "error.hpp"
+
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <span>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#if defined(__linux__) && defined(__x86_64__)
+#define MEASURE_CALCULATOR_JIT 1
+#include <sys/mman.h>
+#else
+#define MEASURE_CALCULATOR_JIT 0
+#endif
+
+namespace Calc {
+
+namespace Detail {
+
+#if MEASURE_CALCULATOR_JIT
+
+// The builtins as plain functions, which the generated code can call.
+
+template <UnaryBuiltin Builtin>
+double UnaryBuiltinFunction(double value) {
+    return ApplyBuiltin(Builtin, value);
+}
+
+template <BinaryBuiltin Builtin>
+double BinaryBuiltinFunction(double left, double right) {
+    return ApplyBuiltin(Builtin, left, right);
+}
+
+template <std::size_t... Indices>
+constexpr auto MakeUnaryBuiltinFunctions(std::index_sequence<Indices...>) {
+    return std::array{&UnaryBuiltinFunction<static_cast<UnaryBuiltin>(Indices)>...};
+}
+
+template <std::size_t... Indices>
+constexpr auto MakeBinaryBuiltinFunctions(std::index_sequence<Indices...>) {
+    return std::array{&BinaryBuiltinFunction<static_cast<BinaryBuiltin>(Indices)>...};
+}
+
+// indexed by the builtins, Atanh and Pow being the last ones
+inline constexpr auto kUnaryBuiltinFunctions = MakeUnaryBuiltinFunctions(
+    std::make_index_sequence<static_cast<std::size_t>(UnaryBuiltin::Atanh) + 1>());
+inline constexpr auto kBinaryBuiltinFunctions = MakeBinaryBuiltinFunctions(
+    std::make_index_sequence<static_cast<std::size_t>(BinaryBuiltin::Pow) + 1>());
+
+inline double CallUnaryCallable(const UnaryCall* call, double value) {
+    return (*call->callable)(value);
+}
+
+inline double CallBinaryCallable(const BinaryCall* call, double left, double right) {
+    return (*call->callable)(left, right);
+}
+
+// Translates the program of a CompiledExpression to x86-64 code (System V ABI) of the signature
+// std::int64_t(double* stack, const double* inputs), returning -1 if every checked instruction
+// had a finite result, and the index of the first one which did not otherwise. As the depth of
+// the stack before each instruction is known, every value gets a fixed slot of the stack.
+class X64Emitter {
+  public:
+    using Function = std::int64_t (*)(double* stack, const double* inputs);
+
+    std::vector<std::uint8_t> Emit(std::span<const Instruction> instructions) {
+        using Code = Instruction::Code;
+
+        // rbx: the stack, rbp: the inputs, and rsp aligned to 16 bytes for the calls
+        Bytes({0x53, 0x55, 0x48, 0x83, 0xEC, 0x08}); // push rbx; push rbp; sub rsp, 8
+        Bytes({0x48, 0x89, 0xFB, 0x48, 0x89, 0xF5}); // mov rbx, rdi; mov rbp, rsi
+
+        std::int32_t depth = 0;
+        for (std::size_t i = 0; i < instructions.size(); ++i) {
+            const auto& instruction = instructions[i];
+            const auto& operand = instruction.operand;
+            if (instruction.PopsOperand()) {
+                --depth;
+            }
+
+            // the slots of the top of the stack and of the right operand
+            const auto top = depth - 1;
+            const auto right = depth;
+
+            switch (instruction.code) {
+                case Code::Push:
+                    MoveToRax(std::bit_cast<std::uint64_t>(operand.constant));
+                    StoreRax(depth++);
+                    break;
+                case Code::Load:
+                    // mov rax, [rbp + disp32]
+                    Bytes({0x48, 0x8B, 0x85});
+                    Int32(static_cast<std::int32_t>(operand.index * sizeof(double)));
+                    StoreRax(depth++);
+                    break;
+                case Code::Duplicate:
+                    LoadXmm(0, top);
+                    StoreXmm(0, depth++);
+                    break;
+                case Code::Scale:
+                    MoveToRax(std::bit_cast<std::uint64_t>(operand.constant));
+                    Bytes({0x66, 0x48, 0x0F, 0x6E, 0xC0}); // movq xmm0, rax
+                    Arithmetic(0x59, top);                 // mulsd xmm0, [slot]
+                    StoreXmm(0, top);
+                    break;
+                case Code::Negate: BitwiseWithRax(0x31, top, 0x8000000000000000); break;
+                case Code::CallUnary:
+                    if (operand.unary->function) {
+                        CallUnary(reinterpret_cast<std::uint64_t>(operand.unary->function), top);
+                    } else {
+                        MoveToRdi(reinterpret_cast<std::uint64_t>(operand.unary));
+                        CallUnary(reinterpret_cast<std::uint64_t>(&CallUnaryCallable), top);
+                    }
+                    break;
+                case Code::CallUnaryBuiltin:
+                    if (operand.unaryBuiltin == UnaryBuiltin::Abs) {
+                        BitwiseWithRax(0x21, top, 0x7FFFFFFFFFFFFFFF);
+                    } else if (operand.unaryBuiltin == UnaryBuiltin::Sqrt) {
+                        Bytes({0xF2, 0x0F, 0x51, 0x83}); // sqrtsd xmm0, [rbx + disp32]
+                        Int32(Slot(top));
+                        StoreXmm(0, top);
+                    } else {
+                        CallUnary(reinterpret_cast<std::uint64_t>(
+                                      kUnaryBuiltinFunctions[static_cast<std::size_t>(
+                                          operand.unaryBuiltin)]),
+                                  top);
+                    }
+                    break;
+                case Code::CallBinary:
+                case Code::CheckedCallBinary:
+                    if (operand.binary->function) {
+                        CallBinary(reinterpret_cast<std::uint64_t>(operand.binary->function), top);
+                    } else {
+                        MoveToRdi(reinterpret_cast<std::uint64_t>(operand.binary));
+                        CallBinary(reinterpret_cast<std::uint64_t>(&CallBinaryCallable), top);
+                    }
+                    break;
+                case Code::CallBinaryBuiltin:
+                case Code::CheckedCallBinaryBuiltin:
+                    CallBinary(reinterpret_cast<std::uint64_t>(
+                                   kBinaryBuiltinFunctions[static_cast<std::size_t>(
+                                       operand.binaryBuiltin)]),
+                               top);
+                    break;
+                case Code::Add: ArithmeticInPlace(0x58, top, right); break;
+                case Code::Subtract: ArithmeticInPlace(0x5C, top, right); break;
+                case Code::Multiply: ArithmeticInPlace(0x59, top, right); break;
+                case Code::Divide: ArithmeticInPlace(0x5E, top, right); break;
+            }
+
+            if (instruction.IsChecked()) {
+                CheckFinite(top, static_cast<std::int32_t>(i));
+            }
+        }
+
+        Bytes({0x48, 0xC7, 0xC0, 0xFF, 0xFF, 0xFF, 0xFF}); // mov rax, -1
+        Return();
+
+        return std::move(code);
+    }
+
+  private:
+    void Bytes(std::initializer_list<std::uint8_t> bytes) {
+        code.insert(code.end(), bytes.begin(), bytes.end());
+    }
+
+    template <class T>
+    void Raw(T value) {
+        std::array<std::uint8_t, sizeof(T)> bytes;
+        std::memcpy(bytes.data(), &value, sizeof(T));
+        code.insert(code.end(), bytes.begin(), bytes.end());
+    }
+
+    void Int32(std::int32_t value) { Raw(value); }
+
+    static std::int32_t Slot(std::int32_t index) {
+        return index * static_cast<std::int32_t>(sizeof(double));
+    }
+
+    void Return() {
+        Bytes({0x48, 0x83, 0xC4, 0x08, 0x5D, 0x5B, 0xC3}); // add rsp, 8; pop rbp; pop rbx; ret
+    }
+
+    void MoveToRax(std::uint64_t value) {
+        Bytes({0x48, 0xB8}); // mov rax, imm64
+        Raw(value);
+    }
+
+    void MoveToRdi(std::uint64_t value) {
+        Bytes({0x48, 0xBF}); // mov rdi, imm64
+        Raw(value);
+    }
+
+    void StoreRax(std::int32_t slot) {
+        Bytes({0x48, 0x89, 0x83}); // mov [rbx + disp32], rax
+        Int32(Slot(slot));
+    }
+
+    // movsd xmm, [rbx + disp32]
+    void LoadXmm(std::uint8_t xmm, std::int32_t slot) {
+        Bytes({0xF2, 0x0F, 0x10, static_cast<std::uint8_t>(0x83 | (xmm << 3))});
+        Int32(Slot(slot));
+    }
+
+    // movsd [rbx + disp32], xmm
+    void StoreXmm(std::uint8_t xmm, std::int32_t slot) {
+        Bytes({0xF2, 0x0F, 0x11, static_cast<std::uint8_t>(0x83 | (xmm << 3))});
+        Int32(Slot(slot));
+    }
+
+    // the scalar double operation of the opcode with xmm0 and [rbx + disp32], into xmm0
+    void Arithmetic(std::uint8_t opcode, std::int32_t slot) {
+        Bytes({0xF2, 0x0F, opcode, 0x83});
+        Int32(Slot(slot));
+    }
+
+    void ArithmeticInPlace(std::uint8_t opcode, std::int32_t left, std::int32_t right) {
+        LoadXmm(0, left);
+        Arithmetic(opcode, right);
+        StoreXmm(0, left);
+    }
+
+    // the bitwise operation of the opcode (and, xor) of the slot with the mask
+    void BitwiseWithRax(std::uint8_t opcode, std::int32_t slot, std::uint64_t mask) {
+        MoveToRax(mask);
+        Bytes({0x48, opcode, 0x83}); // op [rbx + disp32], rax
+        Int32(Slot(slot));
+    }
+
+    void CallRax() { Bytes({0xFF, 0xD0}); }
+
+    void CallUnary(std::uint64_t function, std::int32_t slot) {
+        LoadXmm(0, slot);
+        MoveToRax(function);
+        CallRax();
+        StoreXmm(0, slot);
+    }
+
+    void CallBinary(std::uint64_t function, std::int32_t left) {
+        LoadXmm(0, left);
+        LoadXmm(1, left + 1);
+        MoveToRax(function);
+        CallRax();
+        StoreXmm(0, left);
+    }
+
+    // returns index unless the value in the slot is finite, i.e. its exponent is not all ones
+    void CheckFinite(std::int32_t slot, std::int32_t index) {
+        Bytes({0x48, 0x8B, 0x83}); // mov rax, [rbx + disp32]
+        Int32(Slot(slot));
+        Bytes({0x48, 0xB9});       // mov rcx, imm64
+        Raw(std::uint64_t{0x7FF0000000000000});
+        Bytes({0x48, 0x21, 0xC8}); // and rax, rcx
+        Bytes({0x48, 0x39, 0xC8}); // cmp rax, rcx
+        Bytes({0x75, 0x0E});       // jne over the 14 bytes below
+        Bytes({0x48, 0xC7, 0xC0}); // mov rax, imm32
+        Int32(index);
+        Return();
+    }
+
+    std::vector<std::uint8_t> code;
+};
+
+// Executable memory holding generated code.
+class ExecutableCode {
+  public:
+    ExecutableCode() = default;
+
+    explicit ExecutableCode(std::span<const std::uint8_t> code) {
+        void* memory =
+            mmap(nullptr, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            return;
+        }
+
+        std::memcpy(memory, code.data(), code.size());
+        if (mprotect(memory, code.size(), PROT_READ | PROT_EXEC) != 0) {
+            munmap(memory, code.size());
+            return;
+        }
+
+        data = memory;
+        size = code.size();
+    }
+
+    ExecutableCode(ExecutableCode&& other) noexcept
+        : data(std::exchange(other.data, nullptr)), size(std::exchange(other.size, 0)) {}
+
+    ExecutableCode& operator=(ExecutableCode&& other) noexcept {
+        std::swap(data, other.data);
+        std::swap(size, other.size);
+        return *this;
+    }
+
+    ~ExecutableCode() {
+        if (data) {
+            munmap(data, size);
+        }
+    }
+
+    template <class Function>
+    Function As() const {
+        return reinterpret_cast<Function>(data);
+    }
+
+    explicit operator bool() const { return data != nullptr; }
+
+  private:
+    void* data = nullptr;
+    std::size_t size = 0;
+};
+
+#endif
+
+} // namespace Detail
+
+// A CompiledExpression translated to native code, for expressions evaluated very many times.
+// Only on x86-64 Linux; elsewhere, or if the code cannot be made executable, it evaluates the
+// CompiledExpression the usual way. Custom functions of the Spec must not throw, as the generated
+// code cannot be unwound.
+struct JitExpression {
+    explicit JitExpression(CompiledExpression compiledExpression)
+        : expression(std::move(compiledExpression)) {
+#if MEASURE_CALCULATOR_JIT
+        native = Detail::ExecutableCode(Detail::X64Emitter{}.Emit(expression.instructions));
+#endif
+    }
+
+    // whether Eval() runs native code
+    bool IsNative() const {
+#if MEASURE_CALCULATOR_JIT
+        return static_cast<bool>(native);
+#else
+        return false;
+#endif
+    }
+
+    // the same as CompiledExpression::Eval()
+    std::variant<double, Error> Eval(std::span<const double> inputs = {}) const {
+        if (!IsNative() || inputs.size() < expression.InputCount()) {
+            return expression.Eval(inputs);
+        }
+
+#if MEASURE_CALCULATOR_JIT
+        constexpr std::size_t kInlineStackSize = 16;
+        const auto run = native.As<Detail::X64Emitter::Function>();
+
+        std::int64_t failed = -1;
+        double result = 0.;
+        if (expression.maxStackDepth <= kInlineStackSize) {
+            std::array<double, kInlineStackSize> stack;
+            failed = run(stack.data(), inputs.data());
+            result = stack[0];
+        } else {
+            std::vector<double> stack(expression.maxStackDepth);
+            failed = run(stack.data(), inputs.data());
+            result = stack[0];
+        }
+
+        // the interpreter finds the same error, with the details
+        if (failed >= 0) {
+            return expression.Eval(inputs);
+        }
+
+        return result;
+#else
+        return expression.Eval(inputs);
+#endif
+    }
+
+    const CompiledExpression& Compiled() const { return expression; }
+
+  private:
+    CompiledExpression expression;
+
+#if MEASURE_CALCULATOR_JIT
+    Detail::ExecutableCode native;
+#endif
+};
+
+} // namespace Calc
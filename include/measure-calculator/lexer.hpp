@@ -2,9 +2,13 @@
 
 #include "char-classification.hpp"
 #include "error.hpp"
+#include "number-parsing.hpp"
+#include "observer.hpp"
+#include "prefix-trie.hpp"
 #include "spec.hpp"
 #include "token.hpp"
 
+#include <algorithm>
 #include <optional>
 #include <string_view>
 
@@ -12,7 +16,10 @@ namespace Calc {
 
 namespace Detail {
 
-struct Lexer {
+template <class ObserverType = EvaluationObserver>
+struct BasicLexer {
+    using Observer = ObserverType;
+
     const Spec& spec;
 
     std::string_view totalString;
@@ -20,56 +27,64 @@ struct Lexer {
 
     Token curr;
 
-    void EatWhitespace() {
-        while (!unanalyzed.empty() && IsWhiteSpace(unanalyzed.front())) {
-            unanalyzed.remove_prefix(1);
-        }
+    [[no_unique_address]] Observer observer = {};
+
+    // the position right after curr
+    std::size_t CurrentEnd() const { return totalString.size() - unanalyzed.size(); }
+
+    // After Step() failed with error, makes the invalid part of the input the current (Error)
+    // token, so that the next Step() goes on after it.
+    void SkipInvalid(const Error& error) {
+        const auto start = CurrentEnd();
+        const auto end = std::clamp(error.invalidRange.second, start + 1, totalString.size());
+        curr.str = totalString.substr(start, end - start);
+        unanalyzed = totalString.substr(end);
     }
 
+    void EatWhitespace() { unanalyzed.remove_prefix(RunLength(unanalyzed, kWhiteSpace)); }
+
     std::optional<Error> TokenizeValue() {
-        char* end;
-        auto result = std::strtod(unanalyzed.data(), &end);
-        if (errno == ERANGE || result == HUGE_VAL || result == -HUGE_VAL) {
-            errno = 0;
+        const auto parsed = ParseNumber(unanalyzed);
+        if (parsed.status != ParsedNumber::Status::Ok) {
             curr.data = TokenData::Error{};
             const auto firstInvalid = totalString.size() - unanalyzed.size();
             return Error{
-                .kind = result == HUGE_VAL ? Error::Kind::ConstantTooLarge
-                                           : Error::Kind::ConstantTooSmall,
-                .invalidRange = {firstInvalid, end - unanalyzed.data()},
+                .kind = parsed.status == ParsedNumber::Status::TooLarge
+                            ? Error::Kind::ConstantTooLarge
+                            : Error::Kind::ConstantTooSmall,
+                .invalidRange = {firstInvalid, firstInvalid + parsed.length},
             };
         }
 
         curr = Token{
-            .str = std::string_view(unanalyzed.data(), end - unanalyzed.data()),
-            .data = TokenData::Value{result},
+            .str = unanalyzed.substr(0, parsed.length),
+            .data = TokenData::Value{parsed.value},
         };
-        unanalyzed.remove_prefix(end - unanalyzed.data());
+        unanalyzed.remove_prefix(parsed.length);
 
         return std::nullopt;
     }
 
-    template <class Container>
-    std::variant<Error, const typename Container::mapped_type*>
-    TokenizeFromSpec(Container& lookupSource, bool (*take_while)(char), Error::Kind kind) {
-        const auto begin = unanalyzed.begin();
-        const auto end = std::find_if(unanalyzed.begin(), unanalyzed.end(),
-                                      [take_while](char c) { return !take_while(c); });
-
-        for (auto size = end - begin; size > 0; --size) {
-            std::string_view atom(&*begin, size);
-            if (auto found = lookupSource.find(atom); found != lookupSource.end()) {
-                curr.str = atom;
-                unanalyzed.remove_prefix(size);
-                return &found->second;
-            }
+    template <CharClass charClass, class T>
+    std::variant<Error, const T*> TokenizeFromSpec(const PrefixTrie<T>& lookupSource,
+                                                   Error::Kind kind) {
+        auto [size, found] = lookupSource.LongestPrefix(
+            unanalyzed, [](char c) { return IsOfClass(c, charClass); });
+        if (found) {
+            observer.OnLookup(unanalyzed.substr(0, size), true);
+            curr.str = unanalyzed.substr(0, size);
+            unanalyzed.remove_prefix(size);
+            return found;
         }
 
+        const auto runLength = RunLength(unanalyzed, charClass);
+        observer.OnLookup(unanalyzed.substr(0, runLength), false);
+
         const auto startIndex = totalString.size() - unanalyzed.size();
         curr.data = TokenData::Error{};
         return Error{
             .kind = kind,
-            .invalidRange = {startIndex, startIndex + (end - begin)},
+            .invalidRange = {startIndex, startIndex + runLength},
         };
     }
 
@@ -84,6 +99,65 @@ struct Lexer {
     }
 
     std::optional<Error> Step() {
+        auto error = Tokenize();
+        if (!error && !std::holds_alternative<TokenData::Eof>(curr.data)) {
+            observer.OnToken(curr.str);
+        }
+        if constexpr (kObservesLexing<Observer>) {
+            if (!std::holds_alternative<TokenData::Eof>(curr.data)) {
+                observer.OnLexed(Describe(error));
+            }
+        }
+
+        return error;
+    }
+
+    // curr (which is not Eof) as a LexedToken, error is what Step() returned
+    LexedToken Describe(const std::optional<Error>& error) const {
+        if (error) {
+            // the range of a DigitsExpected may end after the expression
+            return {
+                .kind = TokenKind::Error,
+                .range = {error->invalidRange.first,
+                          std::min(error->invalidRange.second, totalString.size())},
+                .error = error,
+            };
+        }
+
+        const auto end = CurrentEnd();
+        LexedToken result{.kind = TokenKind::Error, .range = {end - curr.str.size(), end}};
+        std::visit(
+            [&result]<class Data>(const Data& data) {
+                if constexpr (std::is_same_v<Data, TokenData::Value>) {
+                    result.kind = TokenKind::Number;
+                } else if constexpr (std::is_same_v<Data, TokenData::Constant>) {
+                    result.kind = TokenKind::Constant;
+                } else if constexpr (std::is_same_v<Data, TokenData::Variable>) {
+                    result.kind = TokenKind::Variable;
+                    result.measureId = data->measureId;
+                } else if constexpr (std::is_same_v<Data, TokenData::Measure>) {
+                    result.kind = TokenKind::Unit;
+                    result.measureId = data->id;
+                } else if constexpr (std::is_same_v<Data, TokenData::UnaryFun>) {
+                    result.kind = TokenKind::UnaryFunction;
+                } else if constexpr (std::is_same_v<Data, TokenData::BinaryFun>) {
+                    result.kind = TokenKind::BinaryFunction;
+                } else if constexpr (std::is_same_v<Data, TokenData::Operator>) {
+                    result.kind = TokenKind::Operator;
+                } else if constexpr (std::is_same_v<Data, TokenData::OpenParen>) {
+                    result.kind = TokenKind::OpenParen;
+                } else if constexpr (std::is_same_v<Data, TokenData::CloseParen>) {
+                    result.kind = TokenKind::CloseParen;
+                } else if constexpr (std::is_same_v<Data, TokenData::Comma>) {
+                    result.kind = TokenKind::Comma;
+                }
+            },
+            curr.data);
+
+        return result;
+    }
+
+    std::optional<Error> Tokenize() {
         EatWhitespace();
 
         if (unanalyzed.empty()) {
@@ -121,22 +195,22 @@ struct Lexer {
 
         if (IsOperatorChar(unanalyzed.front())) {
             auto result =
-                TokenizeFromSpec(spec.opSpecs, IsOperatorChar, Error::Kind::UnknownOperator);
+                TokenizeFromSpec<kOperatorChar>(spec.opIndex, Error::Kind::UnknownOperator);
             if (auto* error = std::get_if<Error>(&result)) {
                 return *error;
             }
-            curr.data = std::get<const Operator*>(result);
+            curr.data = std::get<const OperatorEntry*>(result);
             return std::nullopt;
         }
 
         if (IsIdentifierStartChar(unanalyzed.front())) {
-            auto result = TokenizeFromSpec(spec.identifierSpecs, IsIdentifierChar,
-                                           Error::Kind::UnknownIdentifier);
+            auto result = TokenizeFromSpec<kIdentifierChar>(spec.identifierIndex,
+                                                            Error::Kind::UnknownIdentifier);
             if (auto* error = std::get_if<Error>(&result)) {
                 return *error;
             }
             std::visit([this](const auto& data) { curr.data = &data; },
-                       *std::get<const Identifier*>(result));
+                       *std::get<const IdentifierEntry*>(result));
             return std::nullopt;
         }
 
@@ -150,6 +224,8 @@ struct Lexer {
     }
 };
 
+using Lexer = BasicLexer<>;
+
 } // namespace Detail
 
 } // namespace Calc
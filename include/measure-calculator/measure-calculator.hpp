@@ -1,14 +1,51 @@
 #pragma once
 
+#include "compiled-expression.hpp"
 #include "interpreter.hpp"
+#include "observer.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <limits>
+#include <optional>
+#include <span>
 #include <string_view>
+#include <utility>
 #include <variant>
 
 namespace Calc {
 
-std::variant<double, Error> Evaluate(const Spec& spec, std::string_view str) {
-    Detail::Interpreter parser(spec, str);
+struct MeasuredResult {
+    // in the unit of its measure with multiplier 1
+    double value;
+    // the 1-based index of the measure in SpecBuilder::measures, 0 if the result has no measure
+    std::size_t measureId = 0;
+    // where the measure of the result comes from in the expression
+    std::pair<std::size_t, std::size_t> measureSource = {0, 0};
+
+    bool operator==(const MeasuredResult& other) const = default;
+};
+
+// inputs[i] is the value of the variables with Variable::index == i
+inline std::variant<double, Error> Evaluate(const Spec& spec, std::string_view str,
+                                            std::span<const double> inputs = {}) {
+    Detail::Interpreter<Detail::DirectEvaluation> parser(spec, str, {.inputs = inputs});
+
+    if (auto measuredValue = parser.Parse()) {
+        return measuredValue->value;
+    }
+
+    return parser.error.value();
+}
+
+// Evaluate, reporting its events to a copy of observer
+template <std::derived_from<EvaluationObserver> Observer>
+std::variant<double, Error> Evaluate(const Spec& spec, std::string_view str,
+                                     std::span<const double> inputs, Observer observer) {
+    Detail::Interpreter<Detail::DirectEvaluation, Detail::BasicLexer<Observer>> parser(
+        spec, str, {.inputs = inputs}, std::move(observer));
 
     if (auto measuredValue = parser.Parse()) {
         return measuredValue->value;
@@ -17,4 +54,92 @@ std::variant<double, Error> Evaluate(const Spec& spec, std::string_view str) {
     return parser.error.value();
 }
 
-} // namespace Calc
+// Evaluate, keeping the measure of the result
+inline std::variant<MeasuredResult, Error>
+EvaluateMeasured(const Spec& spec, std::string_view str, std::span<const double> inputs = {}) {
+    Detail::Interpreter<Detail::DirectEvaluation> parser(spec, str, {.inputs = inputs});
+
+    if (auto measuredValue = parser.Parse()) {
+        if (!measuredValue->measure) {
+            return MeasuredResult{.value = measuredValue->value};
+        }
+
+        return MeasuredResult{
+            .value = measuredValue->value,
+            .measureId = measuredValue->measure->id,
+            .measureSource = measuredValue->measure->sourceLocation,
+        };
+    }
+
+    return parser.error.value();
+}
+
+// Converts result into units, amounts[i] being the amount of units[i]: every amount but the last
+// one is whole, and the last one holds the rest, e.g. 1.7 m into {"ft", "in"} is 5 ft 6.93 in.
+// Only as many units are converted into as there are amounts. The units must be of the measure
+// of the result, otherwise the error is a MeasureMismatch at its measureSource.
+inline std::optional<Error> ConvertInto(const Spec& spec, const MeasuredResult& result,
+                                        std::span<const std::string_view> units,
+                                        std::span<double> amounts) {
+    const auto count = std::min(units.size(), amounts.size());
+
+    // the rounding errors of converting into and out of the units, a few ulps of the values
+    constexpr double kTolerance = 8 * std::numeric_limits<double>::epsilon();
+
+    double rest = result.value;
+    for (std::size_t i = 0; i < count; ++i) {
+        const auto unit = spec.FindUnit(units[i]);
+        if (!unit) {
+            return Error{.kind = Error::Kind::UnknownUnit, .invalidRange = {0, 0}};
+        }
+
+        if (unit->id != result.measureId) {
+            return Error{
+                .kind = Error::Kind::MeasureMismatch,
+                .invalidRange = result.measureSource,
+            };
+        }
+
+        amounts[i] = rest / unit->multiplier;
+        if (i + 1 < count) {
+            // e.g. 12 in is 0.9999999999999999 ft, which is meant to be a whole foot
+            const auto nearest = std::round(amounts[i]);
+            amounts[i] = std::abs(amounts[i] - nearest) <= kTolerance * std::abs(nearest)
+                             ? nearest
+                             : std::trunc(amounts[i]);
+            rest -= amounts[i] * unit->multiplier;
+            if (std::abs(rest) <= kTolerance * std::abs(result.value)) {
+                rest = 0.;
+            }
+        }
+    }
+
+    return std::nullopt;
+}
+
+// EvaluateMeasured and ConvertInto in one, without parsing the units as an expression
+inline std::variant<MeasuredResult, Error> EvaluateIn(const Spec& spec, std::string_view str,
+                                                      std::span<const std::string_view> units,
+                                                      std::span<double> amounts,
+                                                      std::span<const double> inputs = {}) {
+    auto result = EvaluateMeasured(spec, str, inputs);
+    if (auto* measured = std::get_if<MeasuredResult>(&result)) {
+        if (auto error = ConvertInto(spec, *measured, units, amounts)) {
+            return *error;
+        }
+    }
+
+    return result;
+}
+
+inline std::variant<CompiledExpression, Error> Compile(const Spec& spec, std::string_view str) {
+    Detail::Interpreter<Detail::Compilation> compiler(spec, str);
+
+    if (compiler.Parse()) {
+        return CompiledExpression(std::move(compiler.backend));
+    }
+
+    return compiler.error.value();
+}
+
+} // namespace Calc
\ No newline at end of file
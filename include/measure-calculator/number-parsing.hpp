@@ -0,0 +1,147 @@
+#pragma once
+
+#include "char-classification.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+namespace Calc {
+
+namespace Detail {
+
+struct ParsedNumber {
+    enum class Status {
+        Ok,
+        TooLarge,
+        TooSmall,
+    };
+
+    Status status;
+    double value;
+    std::size_t length;
+};
+
+// every integer up to 2^53 and these powers of ten are exact doubles, so a single multiplication
+// or division of them is correctly rounded
+constexpr std::array<double, 23> kExactPowersOf10{
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+constexpr int kMaxExactDigits = 15;
+
+// Converts the exact literal, for the ones which are not handled by the fast path.
+inline double ParseNumberSlow(std::string_view literal, bool& outOfRange) {
+    double value = 0.;
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+    auto result = std::from_chars(literal.data(), literal.data() + literal.size(), value);
+    outOfRange = result.ec == std::errc::result_out_of_range;
+#else
+    // strtod needs a terminating null, and is only used by standard libraries lacking
+    // from_chars for doubles
+    std::string terminated(literal);
+    errno = 0;
+    value = std::strtod(terminated.c_str(), nullptr);
+    outOfRange = errno == ERANGE && (value == HUGE_VAL || value == -HUGE_VAL || value == 0.);
+    errno = 0;
+#endif
+    return value;
+}
+
+// Parses the decimal literal at the start of str, never reading past its end. Independent of the
+// locale. str must start with a digit, or a '.' followed by a digit.
+// Accepts digits, an optional fraction, and an optional exponent (e or E, an optional sign, then
+// at least one digit).
+inline ParsedNumber ParseNumber(std::string_view str) {
+    std::size_t length = 0;
+
+    std::uint64_t mantissa = 0;
+    // digits since the first non-zero one
+    std::int64_t significantDigits = 0;
+    std::int64_t fractionDigits = 0;
+
+    const auto eatDigits = [&](bool isFraction) {
+        for (; length < str.size() && IsDigit(str[length]); ++length) {
+            const auto digit = str[length] - '0';
+            if (significantDigits != 0 || digit != 0) {
+                ++significantDigits;
+            }
+            if (significantDigits <= kMaxExactDigits) {
+                mantissa = mantissa * 10 + digit;
+                fractionDigits += isFraction;
+            } else if (!isFraction) {
+                // a dropped integer digit still scales the value
+                --fractionDigits;
+            }
+        }
+    };
+
+    eatDigits(false);
+    if (length < str.size() && str[length] == '.') {
+        ++length;
+        eatDigits(true);
+    }
+
+    std::int64_t exponent = 0;
+    if (length < str.size() && (str[length] == 'e' || str[length] == 'E')) {
+        auto exponentLength = length + 1;
+        bool negative = false;
+        if (exponentLength < str.size() &&
+            (str[exponentLength] == '+' || str[exponentLength] == '-')) {
+            negative = str[exponentLength] == '-';
+            ++exponentLength;
+        }
+
+        if (exponentLength < str.size() && IsDigit(str[exponentLength])) {
+            for (; exponentLength < str.size() && IsDigit(str[exponentLength]); ++exponentLength) {
+                // way out of the range of doubles already, only needs to stay so
+                exponent = std::min<std::int64_t>(exponent * 10 + (str[exponentLength] - '0'),
+                                                  1'000'000'000);
+            }
+            exponent = negative ? -exponent : exponent;
+            length = exponentLength;
+        }
+    }
+
+    const auto scale = exponent - fractionDigits;
+    if (significantDigits <= kMaxExactDigits && scale > -std::int64_t(kExactPowersOf10.size()) &&
+        scale < std::int64_t(kExactPowersOf10.size())) {
+        const auto value = static_cast<double>(mantissa);
+        return {
+            .status = ParsedNumber::Status::Ok,
+            .value = scale < 0 ? value / kExactPowersOf10[-scale] : value * kExactPowersOf10[scale],
+            .length = length,
+        };
+    }
+
+    bool outOfRange = false;
+    const auto value = ParseNumberSlow(str.substr(0, length), outOfRange);
+    // subnormal values lose precision, so they are too small just like those rounding to zero
+    if (value != 0. && std::abs(value) < std::numeric_limits<double>::min()) {
+        return {.status = ParsedNumber::Status::TooSmall, .value = 0., .length = length};
+    }
+    if (outOfRange) {
+        // the value is around 10^(magnitude - 1)
+        const auto magnitude = std::min<std::int64_t>(significantDigits, kMaxExactDigits) + scale;
+        return {
+            .status = magnitude > 0 ? ParsedNumber::Status::TooLarge
+                                    : ParsedNumber::Status::TooSmall,
+            .value = 0.,
+            .length = length,
+        };
+    }
+
+    return {.status = ParsedNumber::Status::Ok, .value = value, .length = length};
+}
+
+} // namespace Detail
+
+} // namespace Calc
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "error.hpp"
+#include "token.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <string_view>
+#include <type_traits>
+
+namespace Calc {
+
+enum class CallKind {
+    UnaryOperator,
+    BinaryOperator,
+    UnaryFunction,
+    BinaryFunction,
+};
+
+// Receives the events of evaluating an expression. Observers derive from it and hide the member
+// functions of the events they are interested in; the others do nothing and are compiled away,
+// and calls are only timed if OnCall() is hidden. Observers are copied into the evaluation, so
+// they should refer to where they collect their data.
+struct EvaluationObserver {
+    // a token was lexed
+    void OnToken(std::string_view) {}
+
+    // a token was lexed, or the characters which are not one (which ends the evaluation)
+    void OnLexed(const LexedToken&) {}
+
+    // the name of an operator or identifier was looked up in the Spec
+    void OnLookup(std::string_view /*name*/, bool /*found*/) {}
+
+    // an expression nested this deep (counting operands of operators) started being parsed
+    void OnDepth(std::size_t) {}
+
+    // an operator or function named name was called, taking duration
+    void OnCall(CallKind, std::string_view /*name*/, std::chrono::nanoseconds /*duration*/) {}
+
+    // the evaluation failed with the error
+    void OnError(const Error&) {}
+};
+
+namespace Detail {
+
+// whether Observer hides the member functions of EvaluationObserver, so that what only they
+// need is skipped otherwise
+
+template <class Observer>
+inline constexpr bool kObservesDepth =
+    !std::is_same_v<decltype(&Observer::OnDepth), decltype(&EvaluationObserver::OnDepth)>;
+
+template <class Observer>
+inline constexpr bool kObservesLexing =
+    !std::is_same_v<decltype(&Observer::OnLexed), decltype(&EvaluationObserver::OnLexed)>;
+
+template <class Observer>
+inline constexpr bool kObservesCalls =
+    !std::is_same_v<decltype(&Observer::OnCall), decltype(&EvaluationObserver::OnCall)>;
+
+} // namespace Detail
+
+} // namespace Calc
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace Calc {
+
+namespace Detail {
+
+struct TrieNode {
+    static constexpr std::uint32_t kNoValue = std::numeric_limits<std::uint32_t>::max();
+
+    std::uint32_t firstEdge = 0;
+    std::uint32_t edgeCount = 0;
+
+    // index into the values of the trie
+    std::uint32_t value = kNoValue;
+};
+
+struct TrieEdge {
+    char c = '\0';
+    std::uint32_t node = 0;
+};
+
+// The nodes and edges of a PrefixTrie, buildable at compile time too.
+struct PrefixTrieTables {
+    std::vector<TrieNode> nodes;
+    std::vector<TrieEdge> edges;
+
+    using Entry = std::pair<std::string_view, std::uint32_t>;
+
+    // names must be unique and non-empty, the second of each entry is the index of its value
+    static constexpr PrefixTrieTables Build(std::vector<Entry> entries) {
+        const auto byName = [](const Entry& left, const Entry& right) {
+            return left.first < right.first;
+        };
+        if (!std::is_sorted(entries.begin(), entries.end(), byName)) {
+            std::sort(entries.begin(), entries.end(), byName);
+        }
+
+        // every character adds at most one node and edge
+        std::size_t characters = 0;
+        for (const auto& entry : entries) {
+            characters += entry.first.size();
+        }
+
+        PrefixTrieTables result;
+        result.nodes.reserve(characters + 1);
+        result.edges.reserve(characters);
+        result.nodes.emplace_back();
+        result.BuildNode(0, entries.begin(), entries.end(), 0);
+        return result;
+    }
+
+  private:
+    using EntryIt = typename std::vector<Entry>::iterator;
+
+    // entries are sorted and all share their first depth characters
+    constexpr void BuildNode(std::uint32_t node, EntryIt first, EntryIt last, std::size_t depth) {
+        if (first != last && first->first.size() == depth) {
+            nodes[node].value = first->second;
+            ++first;
+        }
+
+        // the entries sharing their next character, once for the edges and once for the children
+        const auto groupEnd = [depth, last](EntryIt groupFirst) {
+            const char c = groupFirst->first[depth];
+            return std::find_if(groupFirst, last,
+                                [c, depth](const Entry& entry) { return entry.first[depth] != c; });
+        };
+
+        const auto firstEdge = static_cast<std::uint32_t>(edges.size());
+        for (auto groupFirst = first; groupFirst != last; groupFirst = groupEnd(groupFirst)) {
+            edges.push_back({
+                .c = groupFirst->first[depth],
+                .node = static_cast<std::uint32_t>(nodes.size()),
+            });
+            nodes.emplace_back();
+        }
+        nodes[node].firstEdge = firstEdge;
+        nodes[node].edgeCount = static_cast<std::uint32_t>(edges.size()) - firstEdge;
+
+        auto edge = firstEdge;
+        for (auto groupFirst = first; groupFirst != last; ++edge) {
+            const auto groupLast = groupEnd(groupFirst);
+            BuildNode(edges[edge].node, groupFirst, groupLast, depth + 1);
+            groupFirst = groupLast;
+        }
+    }
+};
+
+// Flat trie over a fixed set of names, finding the longest name a string starts with in a single
+// forward scan. The edges of each node are stored contiguously, sorted by their character.
+// Only views its tables, which are either owned by a Spec or static.
+template <class T>
+struct PrefixTrie {
+    std::span<const TrieNode> nodes;
+    std::span<const TrieEdge> edges;
+    std::span<const T> values;
+
+    // The longest name which is a prefix of str, only looking at the characters before the first
+    // one where continues(c) is false. Returns the length of the name and its value if found.
+    std::pair<std::size_t, const T*> LongestPrefix(std::string_view str,
+                                                   bool (*continues)(char)) const {
+        if (nodes.empty()) {
+            return {0, nullptr};
+        }
+
+        std::pair<std::size_t, const T*> result{0, nullptr};
+
+        std::uint32_t node = 0;
+        for (std::size_t i = 0; i < str.size() && continues(str[i]); ++i) {
+            auto next = Child(nodes[node], str[i]);
+            if (!next) {
+                break;
+            }
+
+            node = *next;
+            if (nodes[node].value != TrieNode::kNoValue) {
+                result = {i + 1, &values[nodes[node].value]};
+            }
+        }
+
+        return result;
+    }
+
+  private:
+    std::optional<std::uint32_t> Child(const TrieNode& node, char c) const {
+        const auto first = edges.begin() + node.firstEdge;
+        const auto last = first + node.edgeCount;
+
+        // nodes deep in the trie rarely have more than a few children
+        constexpr std::uint32_t kLinearSearchLimit = 8;
+        auto found =
+            node.edgeCount <= kLinearSearchLimit
+                ? std::find_if(first, last, [c](const TrieEdge& edge) { return edge.c == c; })
+                : std::lower_bound(first, last, c, [](const TrieEdge& edge, char value) {
+                      return static_cast<unsigned char>(edge.c) <
+                             static_cast<unsigned char>(value);
+                  });
+
+        if (found == last || found->c != c) {
+            return std::nullopt;
+        }
+
+        return found->node;
+    }
+};
+
+} // namespace Detail
+
+} // namespace Calc
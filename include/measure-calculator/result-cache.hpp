@@ -0,0 +1,178 @@
+#pragma once
+
+#include "error.hpp"
+#include "lexer.hpp"
+#include "measure-calculator.hpp"
+#include "spec.hpp"
+#include "token.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+namespace Calc {
+
+// A bounded cache of the results of Evaluate for a Spec, which it must not outlive. Expressions
+// which lex to the same tokens, e.g. ones differing only in whitespace, share their entry, and a
+// hit skips parsing. Only values are cached: errors point into the text, and expressions reading
+// variables depend on the inputs. Safe to use from multiple threads.
+struct ResultCache {
+    struct Stats {
+        std::size_t hits = 0;
+        std::size_t misses = 0;
+    };
+
+    ResultCache(const Spec& spec, std::size_t capacity)
+        : spec(spec), slots(std::max<std::size_t>(capacity, 1)) {
+        index.reserve(slots.size());
+    }
+
+    std::variant<double, Error> Evaluate(std::string_view str) {
+        auto key = CanonicalKey(str);
+        if (!key) {
+            misses.fetch_add(1, std::memory_order_relaxed);
+            return Calc::Evaluate(spec, str);
+        }
+
+        const auto hash = std::hash<std::string>{}(*key);
+        if (auto value = Find(*key, hash)) {
+            hits.fetch_add(1, std::memory_order_relaxed);
+            return *value;
+        }
+
+        misses.fetch_add(1, std::memory_order_relaxed);
+        auto result = Calc::Evaluate(spec, str);
+        if (const auto* value = std::get_if<double>(&result)) {
+            Insert(std::move(*key), hash, *value);
+        }
+
+        return result;
+    }
+
+    Stats GetStats() const {
+        return {
+            .hits = hits.load(std::memory_order_relaxed),
+            .misses = misses.load(std::memory_order_relaxed),
+        };
+    }
+
+  private:
+    struct Slot {
+        std::string key;
+        std::size_t hash = 0;
+        double value = 0.;
+
+        bool used = false;
+        // set on every hit, cleared as the clock hand passes
+        mutable std::atomic<bool> referenced = false;
+    };
+
+    // The tokens of str: values by their bits, everything else by its text. Empty if str does not
+    // lex or reads variables.
+    std::optional<std::string> CanonicalKey(std::string_view str) const {
+        Detail::Lexer lexer{
+            .spec = spec,
+            .totalString = str,
+            .unanalyzed = str,
+            .curr = {.str = "", .data = Detail::TokenData::Error{}},
+        };
+
+        std::string key;
+        key.reserve(str.size());
+        while (true) {
+            if (lexer.Step()) {
+                return std::nullopt;
+            }
+
+            const auto& data = lexer.curr.data;
+            if (std::holds_alternative<Detail::TokenData::Eof>(data)) {
+                return key;
+            }
+            if (std::holds_alternative<Detail::TokenData::Variable>(data)) {
+                return std::nullopt;
+            }
+
+            // tokens never contain the control character nor whitespace
+            if (const auto* value = std::get_if<Detail::TokenData::Value>(&data)) {
+                const auto bytes = std::bit_cast<std::array<char, sizeof(double)>>(*value);
+                key += '\x01';
+                key.append(bytes.begin(), bytes.end());
+            } else {
+                key += lexer.curr.str;
+                key += ' ';
+            }
+        }
+    }
+
+    std::optional<double> Find(const std::string& key, std::size_t hash) const {
+        std::shared_lock lock(mutex);
+
+        const auto found = index.find(hash);
+        if (found == index.end()) {
+            return std::nullopt;
+        }
+
+        const auto& slot = slots[found->second];
+        if (slot.key != key) {
+            return std::nullopt;
+        }
+
+        slot.referenced.store(true, std::memory_order_relaxed);
+        return slot.value;
+    }
+
+    void Insert(std::string key, std::size_t hash, double value) {
+        std::unique_lock lock(mutex);
+
+        // another thread may have inserted it meanwhile, entries with the same hash replace each
+        // other
+        if (const auto found = index.find(hash); found != index.end()) {
+            auto& slot = slots[found->second];
+            slot.key = std::move(key);
+            slot.value = value;
+            return;
+        }
+
+        // CLOCK: evict the first entry not referenced since the hand last passed it
+        while (slots[hand].used && slots[hand].referenced.exchange(false)) {
+            hand = (hand + 1) % slots.size();
+        }
+
+        auto& slot = slots[hand];
+        if (slot.used) {
+            index.erase(slot.hash);
+        }
+
+        slot.key = std::move(key);
+        slot.hash = hash;
+        slot.value = value;
+        slot.used = true;
+        slot.referenced.store(false, std::memory_order_relaxed);
+        index.emplace(hash, hand);
+
+        hand = (hand + 1) % slots.size();
+    }
+
+    const Spec& spec;
+
+    mutable std::shared_mutex mutex;
+    std::vector<Slot> slots;
+    std::unordered_map<std::size_t, std::size_t> index;
+    std::size_t hand = 0;
+
+    std::atomic<std::size_t> hits = 0;
+    std::atomic<std::size_t> misses = 0;
+};
+
+} // namespace Calc
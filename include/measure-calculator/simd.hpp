@@ -0,0 +1,176 @@
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+
+#if defined(__AVX__)
+#    include <immintrin.h>
+#    define MEASURE_CALCULATOR_SIMD_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    include <emmintrin.h>
+#    define MEASURE_CALCULATOR_SIMD_SSE2
+#endif
+
+// vectors of bytes (see RunLength) only need SSE2, which AVX implies
+#if defined(MEASURE_CALCULATOR_SIMD_AVX) || defined(MEASURE_CALCULATOR_SIMD_SSE2)
+#    define MEASURE_CALCULATOR_SIMD_BYTES
+#endif
+
+namespace Calc {
+
+namespace Detail {
+
+// Loops over columns of doubles, using the widest vector instructions enabled for the build,
+// with a scalar loop for the remainder (and for architectures without x86 vector support).
+namespace Simd {
+
+#if defined(MEASURE_CALCULATOR_SIMD_AVX)
+
+#    define MEASURE_CALCULATOR_SIMD
+
+using Vec = __m256d;
+constexpr std::size_t kLanes = 4;
+
+inline Vec Load(const double* from) { return _mm256_loadu_pd(from); }
+inline void Store(double* to, Vec value) { _mm256_storeu_pd(to, value); }
+inline Vec Broadcast(double value) { return _mm256_set1_pd(value); }
+
+inline Vec VecAdd(Vec left, Vec right) { return _mm256_add_pd(left, right); }
+inline Vec VecSubtract(Vec left, Vec right) { return _mm256_sub_pd(left, right); }
+inline Vec VecMultiply(Vec left, Vec right) { return _mm256_mul_pd(left, right); }
+inline Vec VecDivide(Vec left, Vec right) { return _mm256_div_pd(left, right); }
+// the lanes of poison which are NaN, and those of value otherwise
+inline Vec VecSelectNaN(Vec value, Vec poison) {
+    return _mm256_blendv_pd(value, poison, _mm256_cmp_pd(poison, poison, _CMP_UNORD_Q));
+}
+
+#elif defined(MEASURE_CALCULATOR_SIMD_SSE2)
+
+#    define MEASURE_CALCULATOR_SIMD
+
+using Vec = __m128d;
+constexpr std::size_t kLanes = 2;
+
+inline Vec Load(const double* from) { return _mm_loadu_pd(from); }
+inline void Store(double* to, Vec value) { _mm_storeu_pd(to, value); }
+inline Vec Broadcast(double value) { return _mm_set1_pd(value); }
+
+inline Vec VecAdd(Vec left, Vec right) { return _mm_add_pd(left, right); }
+inline Vec VecSubtract(Vec left, Vec right) { return _mm_sub_pd(left, right); }
+inline Vec VecMultiply(Vec left, Vec right) { return _mm_mul_pd(left, right); }
+inline Vec VecDivide(Vec left, Vec right) { return _mm_div_pd(left, right); }
+// the lanes of poison which are NaN, and those of value otherwise
+inline Vec VecSelectNaN(Vec value, Vec poison) {
+    const auto isNaN = _mm_cmpunord_pd(poison, poison);
+    return _mm_or_pd(_mm_and_pd(isNaN, poison), _mm_andnot_pd(isNaN, value));
+}
+
+#endif
+
+// Ops are callable both on a Vec (when available) and on a double for the remainder.
+
+// out[i] = op(values[i]), out may alias values
+template <class Op>
+void Transform(const double* values, double* out, std::size_t count, Op op) {
+    std::size_t i = 0;
+#if defined(MEASURE_CALCULATOR_SIMD)
+    for (; i + kLanes <= count; i += kLanes) {
+        Store(out + i, op(Load(values + i)));
+    }
+#endif
+    for (; i < count; ++i) {
+        out[i] = op(values[i]);
+    }
+}
+
+// out[i] = op(left[i], right[i]), out may alias either input
+template <class Op>
+void Transform(const double* left, const double* right, double* out, std::size_t count, Op op) {
+    std::size_t i = 0;
+#if defined(MEASURE_CALCULATOR_SIMD)
+    for (; i + kLanes <= count; i += kLanes) {
+        Store(out + i, op(Load(left + i), Load(right + i)));
+    }
+#endif
+    for (; i < count; ++i) {
+        out[i] = op(left[i], right[i]);
+    }
+}
+
+struct AddOp {
+#if defined(MEASURE_CALCULATOR_SIMD)
+    Vec operator()(Vec left, Vec right) const { return VecAdd(left, right); }
+#endif
+    double operator()(double left, double right) const { return left + right; }
+};
+
+struct SubtractOp {
+#if defined(MEASURE_CALCULATOR_SIMD)
+    Vec operator()(Vec left, Vec right) const { return VecSubtract(left, right); }
+#endif
+    double operator()(double left, double right) const { return left - right; }
+};
+
+struct MultiplyOp {
+#if defined(MEASURE_CALCULATOR_SIMD)
+    Vec operator()(Vec left, Vec right) const { return VecMultiply(left, right); }
+#endif
+    double operator()(double left, double right) const { return left * right; }
+};
+
+struct DivideOp {
+#if defined(MEASURE_CALCULATOR_SIMD)
+    Vec operator()(Vec left, Vec right) const { return VecDivide(left, right); }
+#endif
+    double operator()(double left, double right) const { return left / right; }
+};
+
+struct ScaleOp {
+    double multiplier;
+
+#if defined(MEASURE_CALCULATOR_SIMD)
+    Vec operator()(Vec value) const { return VecMultiply(value, Broadcast(multiplier)); }
+#endif
+    double operator()(double value) const { return value * multiplier; }
+};
+
+struct NegateOp {
+    // -0. - x flips the sign of zeros too, just like -x
+#if defined(MEASURE_CALCULATOR_SIMD)
+    Vec operator()(Vec value) const { return VecSubtract(Broadcast(-0.), value); }
+#endif
+    double operator()(double value) const { return -value; }
+};
+
+// x - x is 0 for finite values, and NaN for infinities and NaNs: accumulating it keeps the
+// poison 0 while every value is finite, and turns it NaN otherwise
+struct AccumulateNonFiniteOp {
+#if defined(MEASURE_CALCULATOR_SIMD)
+    Vec operator()(Vec value, Vec poison) const {
+        return VecAdd(poison, VecSubtract(value, value));
+    }
+#endif
+    double operator()(double value, double poison) const { return poison + (value - value); }
+};
+
+// the value, or NaN if the poison is NaN: unlike adding the poison, it keeps the sign of -0
+struct ApplyPoisonOp {
+#if defined(MEASURE_CALCULATOR_SIMD)
+    Vec operator()(Vec value, Vec poison) const { return VecSelectNaN(value, poison); }
+#endif
+    double operator()(double value, double poison) const {
+        return std::isnan(poison) ? poison : value;
+    }
+};
+
+inline void Fill(double* values, double value, std::size_t count) {
+    for (std::size_t i = 0; i < count; ++i) {
+        values[i] = value;
+    }
+}
+
+} // namespace Simd
+
+} // namespace Detail
+
+} // namespace Calc
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace Calc {
+
+namespace Detail {
+
+// A stack keeping its first Capacity elements inline, so that it only allocates when it grows
+// deeper than that. The inline elements are not initialized before they are pushed.
+template <class T, std::size_t Capacity>
+class SmallStack {
+    static_assert(std::is_trivially_destructible_v<T>);
+
+  public:
+    SmallStack() {}
+    SmallStack(const SmallStack&) = delete;
+    SmallStack& operator=(const SmallStack&) = delete;
+
+    bool empty() const { return count == 0; }
+    std::size_t size() const { return count; }
+
+    T& back() { return count <= Capacity ? storage.items[count - 1] : spilled.back(); }
+
+    void push_back(const T& item) {
+        if (count < Capacity) {
+            std::construct_at(&storage.items[count], item);
+        } else {
+            spilled.push_back(item);
+        }
+        ++count;
+    }
+
+    void pop_back() {
+        if (count > Capacity) {
+            spilled.pop_back();
+        }
+        --count;
+    }
+
+  private:
+    union Storage {
+        Storage() {}
+
+        T items[Capacity];
+    } storage;
+
+    std::vector<T> spilled;
+    std::size_t count = 0;
+};
+
+} // namespace Detail
+
+} // namespace Calc
@@ -0,0 +1,690 @@
+#pragma once
+
+#include "builtins.hpp"
+#include "data.hpp"
+#include "prefix-trie.hpp"
+#include "spec-tables.hpp"
+#include "spec.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Calc {
+
+// The custom operations of a snapshot, which can not be saved, by the name of the operators and
+// functions calling them. Plain functions are looked up here as well.
+struct CallableRegistry {
+    SpecFor<std::function<double(double)>> unary = {};
+    SpecFor<std::function<double(double, double)>> binary = {};
+};
+
+struct SnapshotError {
+    enum class Kind {
+        CannotOpen,
+        CannotWrite,
+        // not a snapshot, or a corrupted one
+        InvalidFormat,
+        // saved by an incompatible version of the library, or on a different architecture
+        UnsupportedVersion,
+        // see name
+        MissingCallable,
+    };
+
+    Kind kind;
+    // the operator or function of a MissingCallable
+    std::string name = {};
+
+    bool operator==(const SnapshotError& other) const = default;
+};
+
+namespace Detail {
+
+// The layout of a snapshot: a header, then sections of fixed size records, each of them aligned
+// to 8 bytes. Offsets are relative to the start of the file, and names are ranges of the names
+// section. The trie nodes and edges are stored the way PrefixTrie views them.
+
+struct SnapshotSection {
+    std::uint64_t offset = 0;
+    std::uint64_t count = 0;
+};
+
+struct SnapshotHeader {
+    static constexpr std::array<char, 8> kMagic = {'M', 'C', 'S', 'P', 'E', 'C', '\0', '\0'};
+    static constexpr std::uint32_t kVersion = 2;
+    // reads differently with a different byte order
+    static constexpr std::uint32_t kByteOrder = 0x01020304;
+
+    std::array<char, 8> magic = kMagic;
+    std::uint32_t version = kVersion;
+    std::uint32_t byteOrder = kByteOrder;
+
+    std::uint32_t usePostfixShorthand = 0;
+    std::uint32_t padding = 0;
+    std::uint64_t maxDepth = 0;
+
+    SnapshotSection operatorNodes = {};
+    SnapshotSection operatorEdges = {};
+    SnapshotSection operators = {};
+
+    SnapshotSection identifierNodes = {};
+    SnapshotSection identifierEdges = {};
+    SnapshotSection identifiers = {};
+
+    SnapshotSection measureNames = {};
+    SnapshotSection units = {};
+    SnapshotSection unitOffsets = {};
+
+    SnapshotSection names = {};
+};
+
+struct SnapshotName {
+    std::uint64_t offset = 0;
+    std::uint64_t size = 0;
+};
+
+struct SnapshotOperator {
+    SnapshotName name;
+
+    std::uint8_t hasUnary = 0;
+    std::uint8_t unaryBuiltin = 0;
+    std::uint8_t unaryKeepsMeasure = 0;
+
+    std::uint8_t hasBinary = 0;
+    std::uint8_t binaryBuiltin = 0;
+    std::uint8_t binaryKeepsMeasure = 0;
+    std::uint8_t leftAssociative = 0;
+
+    std::uint8_t padding = 0;
+
+    std::uint64_t unaryPrecedence = 0;
+    std::uint64_t binaryPrecedence = 0;
+};
+
+struct SnapshotIdentifier {
+    SnapshotName name;
+
+    // the index of the alternative of the IdentifierEntry
+    std::uint8_t kind = 0;
+    std::uint8_t builtin = 0;
+    std::uint8_t keepsMeasure = 0;
+    std::array<std::uint8_t, 5> padding = {};
+
+    // the value of a Constant, the multiplier of a Measure
+    double number = 0.;
+    // the id of a Measure, the index of a Variable
+    std::uint64_t id = 0;
+    // the measure of a Variable
+    std::uint64_t measureId = 0;
+};
+
+struct SnapshotUnit {
+    SnapshotName name;
+    double multiplier = 1.;
+};
+
+static_assert(std::is_trivially_copyable_v<TrieNode> && sizeof(TrieNode) == 12);
+static_assert(std::is_trivially_copyable_v<TrieEdge> && sizeof(TrieEdge) == 8);
+
+// The file of a snapshot, mapped into memory where possible.
+struct SnapshotFile {
+    std::shared_ptr<const void> storage;
+    std::span<const std::byte> bytes;
+
+    static std::optional<SnapshotFile> Open(const std::filesystem::path& path) {
+#if defined(__unix__) || defined(__APPLE__)
+        const int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return std::nullopt;
+        }
+
+        struct stat info {};
+        if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+            close(fd);
+            return std::nullopt;
+        }
+
+        const auto size = static_cast<std::size_t>(info.st_size);
+        void* mapping = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            return std::nullopt;
+        }
+
+        return SnapshotFile{
+            .storage = std::shared_ptr<const void>(mapping,
+                                                   [size](void* data) { munmap(data, size); }),
+            .bytes = {static_cast<const std::byte*>(mapping), size},
+        };
+#else
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file) {
+            return std::nullopt;
+        }
+
+        const auto size = static_cast<std::size_t>(file.tellg());
+        // operator new aligns for any record
+        std::shared_ptr<std::byte[]> data(new std::byte[size]);
+        file.seekg(0);
+        if (!file.read(reinterpret_cast<char*>(data.get()), static_cast<std::streamsize>(size))) {
+            return std::nullopt;
+        }
+
+        return SnapshotFile{.storage = data, .bytes = {data.get(), size}};
+#endif
+    }
+};
+
+struct Snapshot {
+    static constexpr std::size_t kAlignment = 8;
+
+    // Saving
+
+    // the names of the values of the trie, by their index
+    template <class T>
+    static std::vector<std::string> NamesOf(const PrefixTrie<T>& trie) {
+        std::vector<std::string> result(trie.values.size());
+        if (trie.nodes.empty()) {
+            return result;
+        }
+
+        std::string name;
+        const auto visit = [&](const auto& self, std::uint32_t node) -> void {
+            if (trie.nodes[node].value != TrieNode::kNoValue) {
+                result[trie.nodes[node].value] = name;
+            }
+
+            for (std::uint32_t i = 0; i < trie.nodes[node].edgeCount; ++i) {
+                const auto& edge = trie.edges[trie.nodes[node].firstEdge + i];
+                name.push_back(edge.c);
+                self(self, edge.node);
+                name.pop_back();
+            }
+        };
+        visit(visit, 0);
+
+        return result;
+    }
+
+    // the records of the sections, appended to the file as they are added
+    class Writer {
+      public:
+        Writer() : bytes(sizeof(SnapshotHeader)) {}
+
+        template <class Record>
+        SnapshotSection Add(std::span<const Record> records) {
+            bytes.resize((bytes.size() + kAlignment - 1) / kAlignment * kAlignment);
+
+            const SnapshotSection section{.offset = bytes.size(), .count = records.size()};
+            bytes.resize(bytes.size() + records.size_bytes());
+            if (!records.empty()) {
+                std::memcpy(bytes.data() + section.offset, records.data(), records.size_bytes());
+            }
+
+            return section;
+        }
+
+        SnapshotName AddName(std::string_view name) {
+            const SnapshotName result{.offset = names.size(), .size = name.size()};
+            names.insert(names.end(), name.begin(), name.end());
+            return result;
+        }
+
+        // the file, with the names and the header added
+        std::vector<std::byte> Finish(SnapshotHeader header) {
+            header.names = Add(std::span<const char>(names));
+            std::memcpy(bytes.data(), &header, sizeof(header));
+            return std::move(bytes);
+        }
+
+      private:
+        std::vector<std::byte> bytes;
+        std::vector<char> names;
+    };
+
+    // copies of the edges, without the indeterminate padding
+    static std::vector<std::array<std::byte, sizeof(TrieEdge)>>
+    EdgeRecords(std::span<const TrieEdge> edges) {
+        std::vector<std::array<std::byte, sizeof(TrieEdge)>> result(edges.size());
+        for (std::size_t i = 0; i < edges.size(); ++i) {
+            std::memcpy(result[i].data() + offsetof(TrieEdge, c), &edges[i].c, sizeof(char));
+            std::memcpy(result[i].data() + offsetof(TrieEdge, node), &edges[i].node,
+                        sizeof(std::uint32_t));
+        }
+
+        return result;
+    }
+
+    static std::vector<std::byte> Save(const Spec& spec) {
+        Writer writer;
+        SnapshotHeader header{
+            .usePostfixShorthand = spec.usePostfixShorthand,
+            .maxDepth = spec.maxDepth,
+        };
+
+        const auto operatorNames = NamesOf(spec.opIndex);
+        std::vector<SnapshotOperator> operators;
+        for (std::size_t i = 0; i < spec.opIndex.values.size(); ++i) {
+            const auto& op = spec.opIndex.values[i];
+            SnapshotOperator record{.name = writer.AddName(operatorNames[i])};
+            if (op.unary) {
+                record.hasUnary = 1;
+                record.unaryBuiltin = static_cast<std::uint8_t>(op.unary->call.builtin);
+                record.unaryKeepsMeasure = op.unary->keepsMeasure;
+                record.unaryPrecedence = op.unary->precedence;
+            }
+            if (op.binary) {
+                record.hasBinary = 1;
+                record.binaryBuiltin = static_cast<std::uint8_t>(op.binary->call.builtin);
+                record.binaryKeepsMeasure = op.binary->keepsMeasure;
+                record.leftAssociative = op.binary->leftAssociative;
+                record.binaryPrecedence = op.binary->precedence;
+            }
+            operators.push_back(record);
+        }
+
+        header.operatorNodes = writer.Add(spec.opIndex.nodes);
+        header.operatorEdges =
+            writer.Add(std::span<const std::array<std::byte, sizeof(TrieEdge)>>(
+                EdgeRecords(spec.opIndex.edges)));
+        header.operators = writer.Add(std::span<const SnapshotOperator>(operators));
+
+        const auto identifierNames = NamesOf(spec.identifierIndex);
+        std::vector<SnapshotIdentifier> identifiers;
+        for (std::size_t i = 0; i < spec.identifierIndex.values.size(); ++i) {
+            const auto& entry = spec.identifierIndex.values[i];
+            SnapshotIdentifier record{
+                .name = writer.AddName(identifierNames[i]),
+                .kind = static_cast<std::uint8_t>(entry.index()),
+            };
+            std::visit(
+                [&record]<class T>(const T& value) {
+                    if constexpr (std::is_same_v<T, UnaryFunEntry> ||
+                                  std::is_same_v<T, BinaryFunEntry>) {
+                        record.builtin = static_cast<std::uint8_t>(value.call.builtin);
+                        record.keepsMeasure = value.keepsMeasure;
+                    } else if constexpr (std::is_same_v<T, Constant>) {
+                        record.number = value;
+                    } else if constexpr (std::is_same_v<T, Measure>) {
+                        record.number = value.multiplier;
+                        record.id = value.id;
+                    } else {
+                        record.id = value.index;
+                        record.measureId = value.measureId;
+                    }
+                },
+                entry);
+            identifiers.push_back(record);
+        }
+
+        header.identifierNodes = writer.Add(spec.identifierIndex.nodes);
+        header.identifierEdges =
+            writer.Add(std::span<const std::array<std::byte, sizeof(TrieEdge)>>(
+                EdgeRecords(spec.identifierIndex.edges)));
+        header.identifiers = writer.Add(std::span<const SnapshotIdentifier>(identifiers));
+
+        std::vector<SnapshotName> measureNames;
+        for (const auto name : spec.measureNames) {
+            measureNames.push_back(writer.AddName(name));
+        }
+        header.measureNames = writer.Add(std::span<const SnapshotName>(measureNames));
+
+        std::vector<SnapshotUnit> units;
+        for (const auto& unit : spec.units) {
+            units.push_back({.name = writer.AddName(unit.name), .multiplier = unit.multiplier});
+        }
+        header.units = writer.Add(std::span<const SnapshotUnit>(units));
+
+        const std::vector<std::uint64_t> unitOffsets(spec.unitOffsets.begin(),
+                                                     spec.unitOffsets.end());
+        header.unitOffsets = writer.Add(std::span<const std::uint64_t>(unitOffsets));
+
+        return writer.Finish(header);
+    }
+
+    // Loading
+
+    template <class Record>
+    static std::optional<std::span<const Record>> View(std::span<const std::byte> bytes,
+                                                       SnapshotSection section) {
+        if (section.offset % kAlignment != 0 || section.offset > bytes.size() ||
+            section.count > (bytes.size() - section.offset) / sizeof(Record)) {
+            return std::nullopt;
+        }
+
+        return std::span(reinterpret_cast<const Record*>(bytes.data() + section.offset),
+                         static_cast<std::size_t>(section.count));
+    }
+
+    static bool ValidTrie(std::span<const TrieNode> nodes, std::span<const TrieEdge> edges,
+                          std::size_t valueCount) {
+        for (const auto& node : nodes) {
+            if (node.firstEdge > edges.size() || node.edgeCount > edges.size() - node.firstEdge ||
+                (node.value != TrieNode::kNoValue && node.value >= valueCount)) {
+                return false;
+            }
+        }
+
+        for (const auto& edge : edges) {
+            if (edge.node >= nodes.size()) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    struct Loader {
+        Spec& spec;
+        std::span<const char> names;
+        const CallableRegistry& registry;
+
+        std::optional<std::string_view> Name(SnapshotName name) const {
+            if (name.offset > names.size() || name.size > names.size() - name.offset) {
+                return std::nullopt;
+            }
+
+            return std::string_view(names.data() + name.offset, name.size);
+        }
+
+        template <class Builtin, class Signature>
+        std::variant<Call<Builtin, Signature>, SnapshotError>
+        Bind(std::uint8_t builtin, std::string_view name,
+             const SpecFor<std::function<Signature>>& registered) const {
+            constexpr auto kLast = std::is_same_v<Builtin, UnaryBuiltin>
+                                       ? static_cast<std::uint8_t>(UnaryBuiltin::Atanh)
+                                       : static_cast<std::uint8_t>(BinaryBuiltin::Pow);
+            if (builtin > kLast) {
+                return SnapshotError{.kind = SnapshotError::Kind::InvalidFormat};
+            }
+
+            if (static_cast<Builtin>(builtin) != Builtin::Custom) {
+                return Call<Builtin, Signature>{.builtin = static_cast<Builtin>(builtin)};
+            }
+
+            for (const auto& [registeredName, func] : registered) {
+                if (registeredName == name && func) {
+                    auto copy = func;
+                    return spec.StoreCall(Builtin::Custom, copy);
+                }
+            }
+
+            return SnapshotError{.kind = SnapshotError::Kind::MissingCallable,
+                                 .name = std::string(name)};
+        }
+
+        std::optional<SnapshotError> Operators(std::span<const SnapshotOperator> records) {
+            spec.tables.operators.reserve(records.size());
+            for (const auto& record : records) {
+                const auto name = Name(record.name);
+                if (!name) {
+                    return SnapshotError{.kind = SnapshotError::Kind::InvalidFormat};
+                }
+
+                OperatorEntry entry;
+                if (record.hasUnary) {
+                    auto call = Bind<UnaryBuiltin>(record.unaryBuiltin, *name, registry.unary);
+                    if (auto* error = std::get_if<SnapshotError>(&call)) {
+                        return std::move(*error);
+                    }
+                    entry.unary = UnaryOpEntry{
+                        .call = std::get<UnaryCall>(call),
+                        .keepsMeasure = record.unaryKeepsMeasure != 0,
+                        .precedence = static_cast<std::size_t>(record.unaryPrecedence),
+                    };
+                }
+                if (record.hasBinary) {
+                    auto call = Bind<BinaryBuiltin>(record.binaryBuiltin, *name, registry.binary);
+                    if (auto* error = std::get_if<SnapshotError>(&call)) {
+                        return std::move(*error);
+                    }
+                    entry.binary = BinaryOpEntry{
+                        .call = std::get<BinaryCall>(call),
+                        .leftAssociative = record.leftAssociative != 0,
+                        .keepsMeasure = record.binaryKeepsMeasure != 0,
+                        .precedence = static_cast<std::size_t>(record.binaryPrecedence),
+                    };
+                }
+                spec.tables.operators.push_back(entry);
+            }
+
+            return std::nullopt;
+        }
+
+        std::optional<SnapshotError> Identifiers(std::span<const SnapshotIdentifier> records) {
+            spec.tables.identifiers.reserve(records.size());
+            spec.tables.identifierNames.reserve(records.size());
+            for (const auto& record : records) {
+                const auto name = Name(record.name);
+                if (!name) {
+                    return SnapshotError{.kind = SnapshotError::Kind::InvalidFormat};
+                }
+
+                const auto funEntry = [&]<class Builtin, class Signature>(
+                                          const SpecFor<std::function<Signature>>& registered)
+                    -> std::variant<IdentifierEntry, SnapshotError> {
+                    auto call = Bind<Builtin>(record.builtin, *name, registered);
+                    if (auto* error = std::get_if<SnapshotError>(&call)) {
+                        return std::move(*error);
+                    }
+
+                    return FunEntry<Call<Builtin, Signature>>{
+                        .call = std::get<Call<Builtin, Signature>>(call),
+                        .keepsMeasure = record.keepsMeasure != 0,
+                    };
+                };
+
+                std::variant<IdentifierEntry, SnapshotError> entry;
+                switch (record.kind) {
+                    case 0:
+                        entry = funEntry.template operator()<UnaryBuiltin>(registry.unary);
+                        break;
+                    case 1:
+                        entry = funEntry.template operator()<BinaryBuiltin>(registry.binary);
+                        break;
+                    case 2: entry = IdentifierEntry(Constant{record.number}); break;
+                    case 3:
+                        entry = IdentifierEntry(Measure{
+                            .id = static_cast<std::size_t>(record.id),
+                            .multiplier = record.number,
+                        });
+                        break;
+                    case 4:
+                        entry = IdentifierEntry(Variable{
+                            .index = static_cast<std::size_t>(record.id),
+                            .measureId = static_cast<std::size_t>(record.measureId),
+                        });
+                        break;
+                    default: return SnapshotError{.kind = SnapshotError::Kind::InvalidFormat};
+                }
+
+                if (auto* error = std::get_if<SnapshotError>(&entry)) {
+                    return std::move(*error);
+                }
+                spec.tables.identifierNames.emplace_back(
+                    *name, static_cast<std::uint32_t>(spec.tables.identifiers.size()));
+                spec.tables.identifiers.push_back(std::get<IdentifierEntry>(entry));
+            }
+
+            std::sort(
+                spec.tables.identifierNames.begin(), spec.tables.identifierNames.end(),
+                [](const PrefixTrieTables::Entry& left, const PrefixTrieTables::Entry& right) {
+                    return left.first < right.first;
+                });
+
+            return std::nullopt;
+        }
+    };
+
+    static std::size_t CustomCount(std::span<const SnapshotOperator> operators,
+                                   std::span<const SnapshotIdentifier> identifiers) {
+        std::size_t result = 0;
+        for (const auto& op : operators) {
+            result += op.hasUnary && op.unaryBuiltin == 0;
+            result += op.hasBinary && op.binaryBuiltin == 0;
+        }
+        for (const auto& identifier : identifiers) {
+            result += identifier.kind <= 1 && identifier.builtin == 0;
+        }
+
+        return result;
+    }
+
+    static std::variant<Spec, SnapshotError> Load(SnapshotFile file,
+                                                  const CallableRegistry& registry) {
+        using Kind = SnapshotError::Kind;
+
+        const auto bytes = file.bytes;
+        if (bytes.size() < sizeof(SnapshotHeader)) {
+            return SnapshotError{.kind = Kind::InvalidFormat};
+        }
+
+        SnapshotHeader header;
+        std::memcpy(&header, bytes.data(), sizeof(header));
+        if (header.magic != SnapshotHeader::kMagic) {
+            return SnapshotError{.kind = Kind::InvalidFormat};
+        }
+        if (header.version != SnapshotHeader::kVersion ||
+            header.byteOrder != SnapshotHeader::kByteOrder) {
+            return SnapshotError{.kind = Kind::UnsupportedVersion};
+        }
+
+        const auto operatorNodes = View<TrieNode>(bytes, header.operatorNodes);
+        const auto operatorEdges = View<TrieEdge>(bytes, header.operatorEdges);
+        const auto operators = View<SnapshotOperator>(bytes, header.operators);
+        const auto identifierNodes = View<TrieNode>(bytes, header.identifierNodes);
+        const auto identifierEdges = View<TrieEdge>(bytes, header.identifierEdges);
+        const auto identifiers = View<SnapshotIdentifier>(bytes, header.identifiers);
+        const auto measureNames = View<SnapshotName>(bytes, header.measureNames);
+        const auto units = View<SnapshotUnit>(bytes, header.units);
+        const auto unitOffsets = View<std::uint64_t>(bytes, header.unitOffsets);
+        const auto names = View<char>(bytes, header.names);
+        if (!operatorNodes || !operatorEdges || !operators || !identifierNodes ||
+            !identifierEdges || !identifiers || !measureNames || !units || !unitOffsets ||
+            !names || !ValidTrie(*operatorNodes, *operatorEdges, operators->size()) ||
+            !ValidTrie(*identifierNodes, *identifierEdges, identifiers->size()) ||
+            unitOffsets->size() != measureNames->size() + 1) {
+            return SnapshotError{.kind = Kind::InvalidFormat};
+        }
+
+        Spec result;
+        result.storage = std::move(file.storage);
+
+        // every custom callable needs storage, which must not be reallocated later
+        const auto customCount = CustomCount(*operators, *identifiers);
+        result.unaryCallables.reserve(customCount);
+        result.binaryCallables.reserve(customCount);
+
+        Loader loader{.spec = result, .names = *names, .registry = registry};
+        if (auto error = loader.Operators(*operators)) {
+            return std::move(*error);
+        }
+        if (auto error = loader.Identifiers(*identifiers)) {
+            return std::move(*error);
+        }
+
+        for (const auto& name : *measureNames) {
+            const auto measureName = loader.Name(name);
+            if (!measureName) {
+                return SnapshotError{.kind = Kind::InvalidFormat};
+            }
+            result.tables.measureNames.push_back(*measureName);
+        }
+
+        for (const auto& unit : *units) {
+            const auto unitName = loader.Name(unit.name);
+            if (!unitName) {
+                return SnapshotError{.kind = Kind::InvalidFormat};
+            }
+            result.tables.units.push_back({.name = *unitName, .multiplier = unit.multiplier});
+        }
+
+        std::uint64_t previousOffset = 0;
+        for (const auto offset : *unitOffsets) {
+            if (offset < previousOffset || offset > units->size()) {
+                return SnapshotError{.kind = Kind::InvalidFormat};
+            }
+            result.tables.unitOffsets.push_back(static_cast<std::size_t>(offset));
+            previousOffset = offset;
+        }
+
+        // the tries are viewed where they are mapped
+        result.opIndex = {
+            .nodes = *operatorNodes,
+            .edges = *operatorEdges,
+            .values = result.tables.operators,
+        };
+        result.identifierIndex = {
+            .nodes = *identifierNodes,
+            .edges = *identifierEdges,
+            .values = result.tables.identifiers,
+        };
+        result.identifierNames = result.tables.identifierNames;
+        result.measureNames = result.tables.measureNames;
+        result.units = result.tables.units;
+        result.unitOffsets = result.tables.unitOffsets;
+        result.usePostfixShorthand = header.usePostfixShorthand != 0;
+        result.maxDepth = static_cast<std::size_t>(header.maxDepth);
+
+        return result;
+    }
+};
+
+} // namespace Detail
+
+// Writes spec into a file which LoadSnapshot() reads back. Snapshots can only be loaded by the
+// same version of the library, on machines of the same byte order.
+inline std::optional<SnapshotError> SaveSnapshot(const Spec& spec,
+                                                 const std::filesystem::path& path) {
+    const auto bytes = Detail::Snapshot::Save(spec);
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        return SnapshotError{.kind = SnapshotError::Kind::CannotOpen};
+    }
+
+    file.write(reinterpret_cast<const char*>(bytes.data()),
+               static_cast<std::streamsize>(bytes.size()));
+    file.close();
+    if (!file) {
+        return SnapshotError{.kind = SnapshotError::Kind::CannotWrite};
+    }
+
+    return std::nullopt;
+}
+
+// The spec saved by SaveSnapshot(), with its custom operations taken from registry. The file is
+// mapped into memory (where the platform allows it) and its tries and names are used in place,
+// so that processes loading the same snapshot share them; only the entries of the operators and
+// identifiers are copied, to bind their callables.
+inline std::variant<Spec, SnapshotError> LoadSnapshot(const std::filesystem::path& path,
+                                                      const CallableRegistry& registry = {}) {
+    auto file = Detail::SnapshotFile::Open(path);
+    if (!file) {
+        return SnapshotError{.kind = SnapshotError::Kind::CannotOpen};
+    }
+
+    return Detail::Snapshot::Load(std::move(*file), registry);
+}
+
+} // namespace Calc
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "builtins.hpp"
+#include "data.hpp"
+#include "prefix-trie.hpp"
+
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+namespace Calc {
+
+namespace Detail {
+
+// The operators and identifiers the way a Spec stores them: literal types, so that the tables of
+// a Spec can also be built at compile time.
+
+struct UnaryOpEntry {
+    UnaryCall call = {};
+
+    bool keepsMeasure = true;
+    std::size_t precedence = 0;
+};
+
+struct BinaryOpEntry {
+    BinaryCall call = {};
+
+    bool leftAssociative = true;
+    bool keepsMeasure = true;
+    std::size_t precedence = 0;
+};
+
+struct OperatorEntry {
+    std::optional<UnaryOpEntry> unary = std::nullopt;
+    std::optional<BinaryOpEntry> binary = std::nullopt;
+};
+
+template <class CallType>
+struct FunEntry {
+    CallType call = {};
+
+    bool keepsMeasure = true;
+};
+
+using UnaryFunEntry = FunEntry<UnaryCall>;
+using BinaryFunEntry = FunEntry<BinaryCall>;
+
+using IdentifierEntry = std::variant<UnaryFunEntry, BinaryFunEntry, Constant, Measure, Variable>;
+
+// Everything the lexer and the interpreter look up, the values of the tries are indices into the
+// entries.
+struct SpecTables {
+    std::vector<OperatorEntry> operators;
+    PrefixTrieTables operatorTrie;
+
+    std::vector<IdentifierEntry> identifiers;
+    PrefixTrieTables identifierTrie;
+    // the names of the identifiers with the index of their entry, sorted by name
+    std::vector<PrefixTrieTables::Entry> identifierNames;
+
+    std::vector<std::string_view> measureNames;
+
+    // the units of the measure with id are units[unitOffsets[id - 1]] to units[unitOffsets[id]],
+    // from the largest multiplier to the smallest
+    std::vector<Unit> units;
+    std::vector<std::size_t> unitOffsets;
+};
+
+} // namespace Detail
+
+} // namespace Calc
@@ -1,15 +1,21 @@
 #pragma once
 
+#include "builtins.hpp"
 #include "char-classification.hpp"
 #include "data.hpp"
+#include "prefix-trie.hpp"
+#include "spec-tables.hpp"
 #include "token.hpp"
 
 #include <algorithm>
+#include <cstdint>
 #include <functional>
-#include <set>
+#include <limits>
+#include <memory>
+#include <optional>
+#include <span>
 #include <string_view>
-#include <unordered_map>
-#include <unordered_set>
+#include <type_traits>
 #include <variant>
 #include <vector>
 
@@ -18,16 +24,57 @@ namespace Calc {
 // TODO: move into Spec
 struct MeasureSpec {
     std::string_view name;
-    std::vector<std::pair<std::string_view, double>> units;
+    std::vector<std::pair<std::string_view, double>> units = {};
 };
 
 namespace Detail {
 
-struct Lexer;
+template <class Observer>
+struct BasicLexer;
+
+template <class Backend, class Tokens>
 struct Interpreter;
 
+struct Snapshot;
+
 } // namespace Detail
 
+template <auto Define>
+struct StaticSpec;
+
+// what an identifier of a Spec names, in the order of the alternatives of Identifier
+enum class IdentifierKind {
+    UnaryFunction,
+    BinaryFunction,
+    Constant,
+    Unit,
+    Variable,
+};
+
+struct Completion {
+    std::string_view name;
+    IdentifierKind kind;
+    // the measure of a Unit or a Variable, 0 otherwise
+    std::size_t measureId = 0;
+};
+
+struct CompletionQuery {
+    std::string_view prefix;
+    // only the identifiers of this kind if set
+    std::optional<IdentifierKind> kind = std::nullopt;
+    // only the units and variables of this measure if not 0
+    std::size_t measureId = 0;
+    // where the page starts, 0 for the first page and the next of the previous page after that
+    std::size_t cursor = 0;
+};
+
+struct CompletionPage {
+    // how many completions were filled
+    std::size_t count = 0;
+    // the cursor of the next page, nothing if this page is the last one
+    std::optional<std::size_t> next = std::nullopt;
+};
+
 struct Spec {
     Spec() = default;
     Spec(Spec&&) = default;
@@ -35,35 +82,215 @@ struct Spec {
 
     Spec& operator=(Spec&&) = default;
 
+    // the measure and the multiplier of the unit called name, if there is one
+    std::optional<Measure> FindUnit(std::string_view name) const {
+        const auto [length, entry] =
+            identifierIndex.LongestPrefix(name, Detail::IsIdentifierChar);
+        if (length != name.size() || !entry) {
+            return std::nullopt;
+        }
+
+        if (const auto* measure = std::get_if<Measure>(entry)) {
+            return *measure;
+        }
+
+        return std::nullopt;
+    }
+
+    // the units of the measure with the 1-based measureId, from the largest to the smallest
+    std::span<const Unit> UnitsOf(std::size_t measureId) const {
+        if (measureId == 0 || measureId >= unitOffsets.size()) {
+            return {};
+        }
+
+        return units.subspan(unitOffsets[measureId - 1],
+                             unitOffsets[measureId] - unitOffsets[measureId - 1]);
+    }
+
+    // Fills completions with the identifiers which start with the prefix and match the filters of
+    // query, in the order of their names, as many as it holds. Finding the first one takes a
+    // binary search, the ones after it are next to each other.
+    CompletionPage Complete(const CompletionQuery& query,
+                            std::span<Completion> completions) const {
+        const auto byName = [](const Detail::PrefixTrieTables::Entry& entry,
+                               std::string_view prefix) { return entry.first < prefix; };
+        const auto first =
+            std::lower_bound(identifierNames.begin(), identifierNames.end(), query.prefix, byName);
+        auto it = std::max(first, identifierNames.begin() +
+                                      std::min(query.cursor, identifierNames.size()));
+
+        CompletionPage result;
+        for (; it != identifierNames.end() && it->first.starts_with(query.prefix); ++it) {
+            const auto& entry = identifierIndex.values[it->second];
+            Completion completion{
+                .name = it->first,
+                .kind = static_cast<IdentifierKind>(entry.index()),
+            };
+            if (const auto* measure = std::get_if<Measure>(&entry)) {
+                completion.measureId = measure->id;
+            } else if (const auto* variable = std::get_if<Variable>(&entry)) {
+                completion.measureId = variable->measureId;
+            }
+
+            if ((query.kind && completion.kind != *query.kind) ||
+                (query.measureId != 0 && completion.measureId != query.measureId)) {
+                continue;
+            }
+
+            if (result.count == completions.size()) {
+                result.next = static_cast<std::size_t>(it - identifierNames.begin());
+                break;
+            }
+            completions[result.count++] = completion;
+        }
+
+        return result;
+    }
+
   private:
     friend struct SpecBuilder;
-    friend struct Detail::Lexer;
+    template <class Observer>
+    friend struct Detail::BasicLexer;
+    template <class Backend, class Tokens>
     friend struct Detail::Interpreter;
+    template <auto Define>
+    friend struct StaticSpec;
+    friend struct Detail::Snapshot;
+
+    constexpr Spec(Detail::PrefixTrie<Detail::OperatorEntry> opIndex,
+                   Detail::PrefixTrie<Detail::IdentifierEntry> identifierIndex,
+                   std::span<const Detail::PrefixTrieTables::Entry> identifierNames,
+                   std::span<const std::string_view> measureNames, std::span<const Unit> units,
+                   std::span<const std::size_t> unitOffsets, bool usePostfixShorthand,
+                   std::size_t maxDepth)
+        : opIndex(opIndex),
+          identifierIndex(identifierIndex),
+          identifierNames(identifierNames),
+          measureNames(measureNames),
+          units(units),
+          unitOffsets(unitOffsets),
+          usePostfixShorthand(usePostfixShorthand),
+          maxDepth(maxDepth) {}
+
+    // longest match lookup of the operators and identifiers, viewing either the tables below or
+    // static ones
+    Detail::PrefixTrie<Detail::OperatorEntry> opIndex;
+    Detail::PrefixTrie<Detail::IdentifierEntry> identifierIndex;
+    // see Detail::SpecTables::identifierNames
+    std::span<const Detail::PrefixTrieTables::Entry> identifierNames;
+
+    std::span<const std::string_view> measureNames;
+    // see Detail::SpecTables::units
+    std::span<const Unit> units;
+    std::span<const std::size_t> unitOffsets;
+
+    bool usePostfixShorthand = false;
+    // see SpecBuilder::maxDepth
+    std::size_t maxDepth = 0;
+
+    // empty for a StaticSpec
+    Detail::SpecTables tables;
+    // the characters of the names in the tables, which would otherwise view the strings of the
+    // SpecBuilder
+    std::vector<char> names;
+    // the snapshot a loaded Spec views
+    std::shared_ptr<const void> storage;
+
+    // the callables of the custom operations which are not plain functions
+    std::vector<std::function<double(double)>> unaryCallables;
+    std::vector<std::function<double(double, double)>> binaryCallables;
+
+    void ViewTables() {
+        opIndex = {
+            .nodes = tables.operatorTrie.nodes,
+            .edges = tables.operatorTrie.edges,
+            .values = tables.operators,
+        };
+        identifierIndex = {
+            .nodes = tables.identifierTrie.nodes,
+            .edges = tables.identifierTrie.edges,
+            .values = tables.identifiers,
+        };
+        identifierNames = tables.identifierNames;
+        measureNames = tables.measureNames;
+        units = tables.units;
+        unitOffsets = tables.unitOffsets;
+    }
+
+    void StoreNames() {
+        std::size_t size = 0;
+        for (const auto& [name, index] : tables.identifierNames) {
+            size += name.size();
+        }
+        for (const auto name : tables.measureNames) {
+            size += name.size();
+        }
+        for (const auto& unit : tables.units) {
+            size += unit.name.size();
+        }
+
+        names.resize(size);
+        auto* out = names.data();
+        const auto store = [&out](std::string_view& name) {
+            const auto* first = out;
+            out = std::copy(name.begin(), name.end(), out);
+            name = {first, name.size()};
+        };
 
-    std::unordered_map<std::string_view, Operator> opSpecs;
+        for (auto& [name, index] : tables.identifierNames) {
+            store(name);
+        }
+        for (auto& name : tables.measureNames) {
+            store(name);
+        }
+        for (auto& unit : tables.units) {
+            store(unit.name);
+        }
+    }
 
-    std::unordered_map<std::string_view, Identifier> identifierSpecs;
+    // the callables need to be reserved beforehand, so that they are never reallocated
+    template <class Builtin, class Signature>
+    Detail::Call<Builtin, Signature> StoreCall(Builtin builtin, std::function<Signature>& func) {
+        if (builtin != Builtin::Custom || !func) {
+            return {.builtin = builtin};
+        }
 
-    std::vector<std::string_view> measureNames;
+        if (auto* function = func.template target<Signature*>()) {
+            return {.builtin = builtin, .function = *function};
+        }
 
-    bool usePostfixShorthand;
+        auto& callables = [this]() -> auto& {
+            if constexpr (std::is_same_v<Signature, double(double)>) {
+                return unaryCallables;
+            } else {
+                return binaryCallables;
+            }
+        }();
+        callables.push_back(std::move(func));
+        return {.builtin = builtin, .callable = &callables.back()};
+    }
 };
 
 template <class T>
 using SpecFor = std::vector<std::pair<std::string_view, T>>;
 
 struct SpecBuilder {
-    SpecFor<UnaryOp> unaryOps;
-    SpecFor<BinaryOp> binaryOps;
+    SpecFor<UnaryOp> unaryOps = {};
+    SpecFor<BinaryOp> binaryOps = {};
 
-    SpecFor<UnaryFun> unaryFuns;
-    SpecFor<BinaryFun> binaryFuns;
-    SpecFor<Constant> constants;
+    SpecFor<UnaryFun> unaryFuns = {};
+    SpecFor<BinaryFun> binaryFuns = {};
+    SpecFor<Constant> constants = {};
+    SpecFor<Variable> variables = {};
 
-    std::vector<MeasureSpec> measures;
+    std::vector<MeasureSpec> measures = {};
 
     bool usePostfixShorthand = false;
 
+    // Expressions nested deeper than this fail with NestingTooDeep. Each parenthesized group,
+    // function argument, operator operand and sign is a level (as observed by OnDepth).
+    std::size_t maxDepth = 1000;
+
     enum class Error {
         InvalidOperatorName,
         InvalidIdentifierName,
@@ -72,101 +299,243 @@ struct SpecBuilder {
         DuplicateIdentifier,
 
         ZeroMultiplier,
-        NegativeMultiplier
+        NegativeMultiplier,
+
+        UnknownMeasure,
+
+        // a Custom builtin without a func
+        MissingFunction,
     };
 
-    static bool ValidOp(std::string_view name) {
+    static constexpr bool ValidOp(std::string_view name) {
         return !name.empty() && std::all_of(name.begin(), name.end(), Detail::IsOperatorChar);
     }
 
-    static bool ValidIdentifier(std::string_view name) {
+    static constexpr bool ValidIdentifier(std::string_view name) {
         return !name.empty() && Detail::IsIdentifierStartChar(name.front()) &&
                std::all_of(std::next(name.begin()), name.end(), Detail::IsIdentifierChar);
     }
 
-    // TODO: remove duplication
-    std::variant<Spec, Error> Build() && {
-        Spec result;
+    std::variant<Spec, Error> Build() &&;
+};
 
-        for (auto& [name, spec] : unaryOps) {
-            if (!ValidOp(name)) {
-                return Error::InvalidOperatorName;
-            }
+namespace Detail {
 
-            if (!result.opSpecs.emplace(name, Operator{.unary = std::move(spec)}).second) {
-                return Error::DuplicateOperator;
-            }
+// Validates the specs of builder (a SpecBuilder or a Static::SpecBuilder) and arranges them into
+// tables. makeCall(builtin, func) turns the func of a spec into a Call.
+template <class Builder, class MakeCall>
+constexpr std::variant<SpecTables, SpecBuilder::Error> BuildSpecTables(Builder& builder,
+                                                                       MakeCall makeCall) {
+    using Error = SpecBuilder::Error;
+
+    SpecTables result;
+
+    using NamedOperator = std::pair<std::string_view, OperatorEntry>;
+    std::vector<NamedOperator> ops;
+    ops.reserve(builder.unaryOps.size() + builder.binaryOps.size());
+
+    for (auto& [name, spec] : builder.unaryOps) {
+        if (!SpecBuilder::ValidOp(name)) {
+            return Error::InvalidOperatorName;
+        }
+
+        const auto call = makeCall(spec.builtin, spec.func);
+        if (!call.IsValid()) {
+            return Error::MissingFunction;
+        }
+
+        ops.emplace_back(name, OperatorEntry{
+                                   .unary = UnaryOpEntry{
+                                       .call = call,
+                                       .keepsMeasure = spec.keepsMeasure,
+                                       .precedence = spec.precedence,
+                                   },
+                               });
+    }
+
+    for (auto& [name, spec] : builder.binaryOps) {
+        if (!SpecBuilder::ValidOp(name)) {
+            return Error::InvalidOperatorName;
+        }
+
+        const auto call = makeCall(spec.builtin, spec.func);
+        if (!call.IsValid()) {
+            return Error::MissingFunction;
+        }
+
+        ops.emplace_back(name, OperatorEntry{
+                                   .binary = BinaryOpEntry{
+                                       .call = call,
+                                       .leftAssociative = spec.leftAssociative,
+                                       .keepsMeasure = spec.keepsMeasure,
+                                       .precedence = spec.precedence,
+                                   },
+                               });
+    }
+
+    std::sort(ops.begin(), ops.end(), [](const NamedOperator& left, const NamedOperator& right) {
+        return left.first < right.first;
+    });
+
+    std::vector<PrefixTrieTables::Entry> opNames;
+    opNames.reserve(ops.size());
+    for (auto& [name, op] : ops) {
+        if (opNames.empty() || opNames.back().first != name) {
+            opNames.emplace_back(name, static_cast<std::uint32_t>(result.operators.size()));
+            result.operators.push_back(op);
+            continue;
         }
 
-        for (auto& [name, spec] : binaryOps) {
-            if (!ValidOp(name)) {
-                return Error::InvalidOperatorName;
+        // the unary and the binary operator of the same name
+        auto& merged = result.operators.back();
+        if ((op.unary && merged.unary) || (op.binary && merged.binary)) {
+            return Error::DuplicateOperator;
+        }
+        merged.unary = merged.unary ? merged.unary : op.unary;
+        merged.binary = merged.binary ? merged.binary : op.binary;
+    }
+
+    std::size_t unitCount = 0;
+    for (const auto& measure : builder.measures) {
+        unitCount += measure.units.size();
+    }
+
+    // the entries stay in the order they are added, only their names are sorted
+    const auto identifierCount = unitCount + builder.unaryFuns.size() + builder.binaryFuns.size() +
+                                 builder.constants.size() + builder.variables.size();
+    std::vector<PrefixTrieTables::Entry> identifierNames;
+    identifierNames.reserve(identifierCount);
+    result.identifiers.reserve(identifierCount);
+    const auto addIdentifier = [&](std::string_view name, IdentifierEntry entry) {
+        identifierNames.emplace_back(name, static_cast<std::uint32_t>(result.identifiers.size()));
+        result.identifiers.push_back(entry);
+    };
+
+    result.measureNames.reserve(builder.measures.size());
+    result.units.reserve(unitCount);
+    result.unitOffsets.reserve(builder.measures.size() + 1);
+    result.unitOffsets.push_back(0);
+    for (auto& [name, units] : builder.measures) {
+        result.measureNames.push_back(name);
+        for (auto& [unitName, multiplier] : units) {
+            if (!SpecBuilder::ValidIdentifier(unitName)) {
+                return Error::InvalidIdentifierName;
             }
 
-            auto& op = result.opSpecs[name];
-            if (op.binary) {
-                return Error::DuplicateOperator;
+            if (multiplier < 0.) {
+                return Error::NegativeMultiplier;
             }
-            op.binary = std::move(spec);
-        }
-
-        for (auto&& [name, units] : measures) {
-            result.measureNames.push_back(name);
-            for (auto& [unitName, multiplier] : units) {
-                if (!ValidIdentifier(unitName)) {
-                    return Error::InvalidIdentifierName;
-                }
-
-                if (multiplier < 0.) {
-                    return Error::NegativeMultiplier;
-                }
-
-                if (multiplier < std::numeric_limits<double>::epsilon()) {
-                    return Error::ZeroMultiplier;
-                }
-
-                auto inserted = result.identifierSpecs
-                                    .emplace(unitName,
-                                             Measure{
-                                                 .id = result.measureNames.size(),
-                                                 .multiplier = multiplier,
-                                             })
-                                    .second;
-                if (!inserted) {
-                    return Error::DuplicateIdentifier;
-                }
+
+            if (multiplier < std::numeric_limits<double>::epsilon()) {
+                return Error::ZeroMultiplier;
             }
+
+            addIdentifier(unitName, Measure{
+                                        .id = result.measureNames.size(),
+                                        .multiplier = multiplier,
+                                    });
+            result.units.push_back({.name = unitName, .multiplier = multiplier});
         }
 
-        auto addIdentifiers = [&result](auto& source) -> std::optional<Error> {
-            for (auto& [name, spec] : source) {
-                if (!ValidIdentifier(name)) {
-                    return Error::InvalidIdentifierName;
-                }
+        std::sort(result.units.begin() + result.unitOffsets.back(), result.units.end(),
+                  [](const Unit& left, const Unit& right) {
+                      return left.multiplier > right.multiplier;
+                  });
+        result.unitOffsets.push_back(result.units.size());
+    }
+
+    const auto addIdentifiers = [&](auto& source, auto makeEntry) -> std::optional<Error> {
+        for (auto& [name, spec] : source) {
+            if (!SpecBuilder::ValidIdentifier(name)) {
+                return Error::InvalidIdentifierName;
+            }
 
-                if (!result.identifierSpecs.emplace(name, std::move(spec)).second) {
-                    return Error::DuplicateIdentifier;
-                }
+            auto entry = makeEntry(spec);
+            if (!entry) {
+                return Error::MissingFunction;
             }
+            addIdentifier(name, *entry);
+        }
+
+        return std::nullopt;
+    };
 
+    const auto funEntry = [&](auto& fun) -> std::optional<IdentifierEntry> {
+        const auto call = makeCall(fun.builtin, fun.func);
+        if (!call.IsValid()) {
             return std::nullopt;
+        }
+
+        return FunEntry<std::remove_const_t<decltype(call)>>{
+            .call = call,
+            .keepsMeasure = fun.keepsMeasure,
         };
+    };
+    const auto plainEntry = [](const auto& spec) { return std::optional<IdentifierEntry>(spec); };
 
-        if (auto err = addIdentifiers(unaryFuns)) {
-            return *err;
-        }
-        if (auto err = addIdentifiers(binaryFuns)) {
-            return *err;
-        }
-        if (auto err = addIdentifiers(constants)) {
-            return *err;
+    if (auto err = addIdentifiers(builder.unaryFuns, funEntry)) {
+        return *err;
+    }
+    if (auto err = addIdentifiers(builder.binaryFuns, funEntry)) {
+        return *err;
+    }
+    if (auto err = addIdentifiers(builder.constants, plainEntry)) {
+        return *err;
+    }
+
+    for (const auto& [name, variable] : builder.variables) {
+        if (variable.measureId > result.measureNames.size()) {
+            return Error::UnknownMeasure;
         }
+    }
+    if (auto err = addIdentifiers(builder.variables, plainEntry)) {
+        return *err;
+    }
+
+    // duplicates end up next to each other
+    std::sort(identifierNames.begin(), identifierNames.end(),
+              [](const PrefixTrieTables::Entry& left, const PrefixTrieTables::Entry& right) {
+                  return left.first < right.first;
+              });
+    const auto duplicate = std::adjacent_find(
+        identifierNames.begin(), identifierNames.end(),
+        [](const PrefixTrieTables::Entry& left, const PrefixTrieTables::Entry& right) {
+            return left.first == right.first;
+        });
+    if (duplicate != identifierNames.end()) {
+        return Error::DuplicateIdentifier;
+    }
 
-        result.usePostfixShorthand = usePostfixShorthand;
+    result.operatorTrie = PrefixTrieTables::Build(std::move(opNames));
+    result.identifierTrie = PrefixTrieTables::Build(identifierNames);
+    result.identifierNames = std::move(identifierNames);
 
-        return result;
+    return result;
+}
+
+} // namespace Detail
+
+inline std::variant<Spec, SpecBuilder::Error> SpecBuilder::Build() && {
+    Spec result;
+
+    // every custom callable might need storage, which must not be reallocated later
+    result.unaryCallables.reserve(unaryOps.size() + unaryFuns.size());
+    result.binaryCallables.reserve(binaryOps.size() + binaryFuns.size());
+
+    auto tables = Detail::BuildSpecTables(
+        *this, [&result](auto builtin, auto& func) { return result.StoreCall(builtin, func); });
+    if (auto* error = std::get_if<Error>(&tables)) {
+        return *error;
     }
-};
+
+    result.tables = std::move(std::get<Detail::SpecTables>(tables));
+    result.StoreNames();
+    result.ViewTables();
+    result.usePostfixShorthand = usePostfixShorthand;
+    result.maxDepth = maxDepth;
+
+    return result;
+}
 
 template <class FirstContainer, class... Containers>
 auto SpecUnion(FirstContainer firstContainer, Containers... containers) {
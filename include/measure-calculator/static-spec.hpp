@@ -0,0 +1,275 @@
+#pragma once
+
+#include "spec.hpp"
+
+#include <algorithm>
+#include <array>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace Calc {
+
+// Counterparts of the SpecBuilder types which can be constexpr: the custom operations are plain
+// functions instead of std::functions, and the lists are spans of (static) arrays.
+namespace Static {
+
+struct UnaryOp {
+    UnaryBuiltin builtin = UnaryBuiltin::Custom;
+    // only called for UnaryBuiltin::Custom
+    double (*func)(double) = nullptr;
+
+    bool keepsMeasure = true;
+    std::size_t precedence = 0;
+};
+
+struct BinaryOp {
+    BinaryBuiltin builtin = BinaryBuiltin::Custom;
+    // only called for BinaryBuiltin::Custom
+    double (*func)(double, double) = nullptr;
+
+    bool leftAssociative = true;
+    bool keepsMeasure = true;
+    std::size_t precedence = 0;
+};
+
+template <class T>
+struct Fun {
+    typename Detail::BuiltinOf<T>::type builtin = {};
+    // only called for the Custom builtin
+    T* func = nullptr;
+
+    bool keepsMeasure = true;
+};
+
+using UnaryFun = Fun<double(double)>;
+using BinaryFun = Fun<double(double, double)>;
+
+struct MeasureSpec {
+    std::string_view name;
+    std::span<const std::pair<std::string_view, double>> units = {};
+};
+
+template <class T>
+using SpecFor = std::span<const std::pair<std::string_view, T>>;
+
+struct SpecBuilder {
+    SpecFor<UnaryOp> unaryOps = {};
+    SpecFor<BinaryOp> binaryOps = {};
+
+    SpecFor<UnaryFun> unaryFuns = {};
+    SpecFor<BinaryFun> binaryFuns = {};
+    SpecFor<Constant> constants = {};
+    SpecFor<Variable> variables = {};
+
+    std::span<const MeasureSpec> measures = {};
+
+    bool usePostfixShorthand = false;
+    // see Calc::SpecBuilder::maxDepth
+    std::size_t maxDepth = 1000;
+};
+
+// The compile time counterpart of Calc::SpecUnion.
+template <class T, std::size_t... Sizes>
+constexpr std::array<T, (Sizes + ... + 0)> SpecUnion(const std::array<T, Sizes>&... specs) {
+    std::array<T, (Sizes + ... + 0)> result{};
+    auto out = result.begin();
+    ((out = std::copy(specs.begin(), specs.end(), out)), ...);
+    return result;
+}
+
+// Conversions to the SpecBuilder types.
+
+inline Calc::UnaryOp ToDynamic(const UnaryOp& op) {
+    return {
+        .builtin = op.builtin,
+        .func = op.func,
+        .keepsMeasure = op.keepsMeasure,
+        .precedence = op.precedence,
+    };
+}
+
+inline Calc::BinaryOp ToDynamic(const BinaryOp& op) {
+    return {
+        .builtin = op.builtin,
+        .func = op.func,
+        .leftAssociative = op.leftAssociative,
+        .keepsMeasure = op.keepsMeasure,
+        .precedence = op.precedence,
+    };
+}
+
+template <class T>
+Calc::Fun<T> ToDynamic(const Fun<T>& fun) {
+    return {.builtin = fun.builtin, .func = fun.func, .keepsMeasure = fun.keepsMeasure};
+}
+
+inline Constant ToDynamic(Constant constant) { return constant; }
+
+inline Variable ToDynamic(const Variable& variable) { return variable; }
+
+inline Calc::MeasureSpec ToDynamic(const MeasureSpec& measure) {
+    return {.name = measure.name, .units = {measure.units.begin(), measure.units.end()}};
+}
+
+template <class T, std::size_t Size>
+auto ToSpecFor(const std::array<std::pair<std::string_view, T>, Size>& specs) {
+    Calc::SpecFor<decltype(ToDynamic(std::declval<const T&>()))> result;
+    result.reserve(specs.size());
+    for (const auto& [name, spec] : specs) {
+        result.emplace_back(name, ToDynamic(spec));
+    }
+
+    return result;
+}
+
+} // namespace Static
+
+namespace Detail {
+
+struct MakeStaticCall {
+    template <class Builtin, class Signature>
+    constexpr Call<Builtin, Signature> operator()(Builtin builtin, Signature* func) const {
+        return {.builtin = builtin, .function = func};
+    }
+};
+
+template <auto Define>
+constexpr std::variant<SpecTables, SpecBuilder::Error> BuildStaticTables() {
+    const Static::SpecBuilder builder = Define();
+    return BuildSpecTables(builder, MakeStaticCall{});
+}
+
+struct StaticTableSizes {
+    std::size_t operators = 0;
+    std::size_t operatorNodes = 0;
+    std::size_t operatorEdges = 0;
+
+    std::size_t identifiers = 0;
+    std::size_t identifierNodes = 0;
+    std::size_t identifierEdges = 0;
+
+    std::size_t measures = 0;
+    std::size_t units = 0;
+};
+
+template <auto Define>
+constexpr StaticTableSizes SizesOfStaticTables() {
+    const auto built = BuildStaticTables<Define>();
+    const auto* tables = std::get_if<SpecTables>(&built);
+    if (!tables) {
+        return {};
+    }
+
+    return {
+        .operators = tables->operators.size(),
+        .operatorNodes = tables->operatorTrie.nodes.size(),
+        .operatorEdges = tables->operatorTrie.edges.size(),
+        .identifiers = tables->identifiers.size(),
+        .identifierNodes = tables->identifierTrie.nodes.size(),
+        .identifierEdges = tables->identifierTrie.edges.size(),
+        .measures = tables->measureNames.size(),
+        .units = tables->units.size(),
+    };
+}
+
+// SpecTables in arrays, which can outlive the compilation
+template <StaticTableSizes Sizes>
+struct StaticTables {
+    std::array<OperatorEntry, Sizes.operators> operators;
+    std::array<TrieNode, Sizes.operatorNodes> operatorNodes;
+    std::array<TrieEdge, Sizes.operatorEdges> operatorEdges;
+
+    std::array<IdentifierEntry, Sizes.identifiers> identifiers;
+    std::array<TrieNode, Sizes.identifierNodes> identifierNodes;
+    std::array<TrieEdge, Sizes.identifierEdges> identifierEdges;
+    std::array<PrefixTrieTables::Entry, Sizes.identifiers> identifierNames;
+
+    std::array<std::string_view, Sizes.measures> measureNames;
+    std::array<Unit, Sizes.units> units;
+    std::array<std::size_t, Sizes.measures + 1> unitOffsets;
+};
+
+template <auto Define>
+constexpr auto MakeStaticTables() {
+    constexpr auto kSizes = SizesOfStaticTables<Define>();
+
+    StaticTables<kSizes> result{};
+    const auto built = BuildStaticTables<Define>();
+    if (const auto* tables = std::get_if<SpecTables>(&built)) {
+        std::copy(tables->operators.begin(), tables->operators.end(), result.operators.begin());
+        std::copy(tables->operatorTrie.nodes.begin(), tables->operatorTrie.nodes.end(),
+                  result.operatorNodes.begin());
+        std::copy(tables->operatorTrie.edges.begin(), tables->operatorTrie.edges.end(),
+                  result.operatorEdges.begin());
+
+        std::copy(tables->identifiers.begin(), tables->identifiers.end(),
+                  result.identifiers.begin());
+        std::copy(tables->identifierTrie.nodes.begin(), tables->identifierTrie.nodes.end(),
+                  result.identifierNodes.begin());
+        std::copy(tables->identifierTrie.edges.begin(), tables->identifierTrie.edges.end(),
+                  result.identifierEdges.begin());
+        std::copy(tables->identifierNames.begin(), tables->identifierNames.end(),
+                  result.identifierNames.begin());
+
+        std::copy(tables->measureNames.begin(), tables->measureNames.end(),
+                  result.measureNames.begin());
+        std::copy(tables->units.begin(), tables->units.end(), result.units.begin());
+        std::copy(tables->unitOffsets.begin(), tables->unitOffsets.end(),
+                  result.unitOffsets.begin());
+    }
+
+    return result;
+}
+
+template <auto Define>
+constexpr std::optional<SpecBuilder::Error> StaticSpecError() {
+    const auto built = BuildStaticTables<Define>();
+    if (const auto* error = std::get_if<SpecBuilder::Error>(&built)) {
+        return *error;
+    }
+
+    return std::nullopt;
+}
+
+} // namespace Detail
+
+// A Spec built during compilation into read-only tables, so that getting it costs nothing at
+// runtime. Define is a constexpr function (or lambda) returning the Static::SpecBuilder, whose
+// spans must refer to static arrays.
+template <auto Define>
+struct StaticSpec {
+    static constexpr std::optional<SpecBuilder::Error> kError = Detail::StaticSpecError<Define>();
+
+    static const Spec& Get() {
+        static_assert(!kError, "the Static::SpecBuilder is invalid, see kError");
+        return kSpec;
+    }
+
+  private:
+    static constexpr auto kTables = Detail::MakeStaticTables<Define>();
+
+    static constinit inline const Spec kSpec{
+        Detail::PrefixTrie<Detail::OperatorEntry>{
+            .nodes = kTables.operatorNodes,
+            .edges = kTables.operatorEdges,
+            .values = kTables.operators,
+        },
+        Detail::PrefixTrie<Detail::IdentifierEntry>{
+            .nodes = kTables.identifierNodes,
+            .edges = kTables.identifierEdges,
+            .values = kTables.identifiers,
+        },
+        kTables.identifierNames,
+        kTables.measureNames,
+        kTables.units,
+        kTables.unitOffsets,
+        Define().usePostfixShorthand,
+        Define().maxDepth,
+    };
+};
+
+} // namespace Calc
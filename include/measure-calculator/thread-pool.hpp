@@ -0,0 +1,206 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Calc {
+
+namespace Detail {
+
+// Threads kept around for running tasks in parallel, the thread calling Run() taking part too.
+class ThreadPool {
+  public:
+    explicit ThreadPool(std::size_t threads) {
+        for (std::size_t i = 1; i < threads; ++i) {
+            workers.emplace_back([this, i] { Work(i); });
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    ~ThreadPool() {
+        {
+            std::lock_guard lock(mutex);
+            stopping = true;
+        }
+        start.notify_all();
+
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    // one thread for every core
+    static ThreadPool& Shared() {
+        static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+        return pool;
+    }
+
+    std::size_t Size() const { return workers.size() + 1; }
+
+    // Calls task(i) for every i < participants (at most Size()) on different threads, task(0) on
+    // the calling one, and returns once all of them returned. task must not throw, nor Run() more
+    // tasks on the same pool.
+    void Run(std::size_t participants, const std::function<void(std::size_t)>& task) {
+        participants = std::clamp<std::size_t>(participants, 1, Size());
+        if (participants == 1) {
+            task(0);
+            return;
+        }
+
+        std::lock_guard runLock(runMutex);
+        {
+            std::lock_guard lock(mutex);
+            job = &task;
+            jobParticipants = participants;
+            remaining = participants - 1;
+            ++generation;
+        }
+        start.notify_all();
+
+        task(0);
+
+        std::unique_lock lock(mutex);
+        done.wait(lock, [this] { return remaining == 0; });
+    }
+
+  private:
+    void Work(std::size_t index) {
+        std::size_t seenGeneration = 0;
+        std::unique_lock lock(mutex);
+        while (true) {
+            start.wait(lock, [&] { return stopping || generation != seenGeneration; });
+            if (stopping) {
+                return;
+            }
+
+            seenGeneration = generation;
+            if (index >= jobParticipants) {
+                continue;
+            }
+
+            const auto* task = job;
+            lock.unlock();
+            (*task)(index);
+            lock.lock();
+
+            if (--remaining == 0) {
+                done.notify_one();
+            }
+        }
+    }
+
+    std::vector<std::thread> workers;
+
+    // only one task runs at a time
+    std::mutex runMutex;
+
+    std::mutex mutex;
+    std::condition_variable start;
+    std::condition_variable done;
+
+    const std::function<void(std::size_t)>* job = nullptr;
+    std::size_t jobParticipants = 0;
+    std::size_t remaining = 0;
+    std::size_t generation = 0;
+    bool stopping = false;
+};
+
+// Indices [0, count) split between the participants of a ThreadPool task. Each one takes chunks
+// from the front of its own range, and once that is empty steals the back half of another's.
+class WorkStealingRanges {
+  public:
+    WorkStealingRanges(std::uint32_t count, std::size_t participants, std::uint32_t chunkSize)
+        : ranges(participants), chunkSize(chunkSize) {
+        for (std::size_t i = 0; i < participants; ++i) {
+            ranges[i].packed.store(Pack(static_cast<std::uint32_t>(count * i / participants),
+                                        static_cast<std::uint32_t>(count * (i + 1) / participants)),
+                                   std::memory_order_relaxed);
+        }
+    }
+
+    // The next chunk of the participant, [first, second), or nothing once every range is empty.
+    std::optional<std::pair<std::uint32_t, std::uint32_t>> Next(std::size_t participant) {
+        auto& own = ranges[participant].packed;
+        if (auto chunk = TakeFront(own)) {
+            return chunk;
+        }
+
+        for (std::size_t i = 1; i < ranges.size(); ++i) {
+            auto& victim = ranges[(participant + i) % ranges.size()].packed;
+            if (auto stolen = StealBack(victim)) {
+                // no one else takes from an empty range, so nothing else writes own meanwhile
+                const auto middle = std::min(stolen->first + chunkSize, stolen->second);
+                own.store(Pack(middle, stolen->second), std::memory_order_release);
+                return std::pair{stolen->first, middle};
+            }
+        }
+
+        return std::nullopt;
+    }
+
+  private:
+    static std::uint64_t Pack(std::uint32_t first, std::uint32_t last) {
+        return (static_cast<std::uint64_t>(first) << 32) | last;
+    }
+
+    static std::pair<std::uint32_t, std::uint32_t> Unpack(std::uint64_t packed) {
+        return {static_cast<std::uint32_t>(packed >> 32), static_cast<std::uint32_t>(packed)};
+    }
+
+    std::optional<std::pair<std::uint32_t, std::uint32_t>>
+    TakeFront(std::atomic<std::uint64_t>& range) const {
+        auto packed = range.load(std::memory_order_acquire);
+        while (true) {
+            const auto [first, last] = Unpack(packed);
+            if (first >= last) {
+                return std::nullopt;
+            }
+
+            const auto middle = std::min(first + chunkSize, last);
+            if (range.compare_exchange_weak(packed, Pack(middle, last),
+                                            std::memory_order_acq_rel)) {
+                return std::pair{first, middle};
+            }
+        }
+    }
+
+    static std::optional<std::pair<std::uint32_t, std::uint32_t>>
+    StealBack(std::atomic<std::uint64_t>& range) {
+        auto packed = range.load(std::memory_order_acquire);
+        while (true) {
+            const auto [first, last] = Unpack(packed);
+            if (first >= last) {
+                return std::nullopt;
+            }
+
+            const auto middle = first + (last - first) / 2;
+            if (range.compare_exchange_weak(packed, Pack(first, middle),
+                                            std::memory_order_acq_rel)) {
+                return std::pair{middle, last};
+            }
+        }
+    }
+
+    // on separate cache lines, as they are written by different threads
+    struct alignas(64) Range {
+        std::atomic<std::uint64_t> packed = 0;
+    };
+
+    std::vector<Range> ranges;
+    std::uint32_t chunkSize;
+};
+
+} // namespace Detail
+
+} // namespace Calc
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "error.hpp"
+#include "lexer.hpp"
+#include "spec.hpp"
+#include "token.hpp"
+
+#include <cstddef>
+#include <iterator>
+#include <optional>
+#include <ranges>
+#include <string_view>
+
+namespace Calc {
+
+// Forward iterator over the tokens of an expression, lexed exactly the way the evaluation lexes
+// them. The characters which are not a token are an Error token, which is the last one. Copying
+// and advancing it does not allocate.
+class TokenIterator {
+  public:
+    using value_type = LexedToken;
+    using difference_type = std::ptrdiff_t;
+
+    TokenIterator() = default;
+
+    TokenIterator(const Spec& spec, std::string_view str)
+        : spec(&spec), totalString(str), unanalyzed(str), ended(false) {
+        ++*this;
+    }
+
+    const LexedToken& operator*() const { return current; }
+    const LexedToken* operator->() const { return &current; }
+
+    TokenIterator& operator++() {
+        if (stopped) {
+            ended = true;
+            return *this;
+        }
+
+        Detail::Lexer lexer{
+            .spec = *spec,
+            .totalString = totalString,
+            .unanalyzed = unanalyzed,
+            .curr = {.str = "", .data = Detail::TokenData::Error{}},
+        };
+        const auto error = lexer.Step();
+        unanalyzed = lexer.unanalyzed;
+        if (!error && std::holds_alternative<Detail::TokenData::Eof>(lexer.curr.data)) {
+            ended = true;
+            return *this;
+        }
+
+        current = lexer.Describe(error);
+        stopped = current.kind == TokenKind::Error;
+        return *this;
+    }
+
+    TokenIterator operator++(int) {
+        auto result = *this;
+        ++*this;
+        return result;
+    }
+
+    bool operator==(std::default_sentinel_t) const { return ended; }
+
+    bool operator==(const TokenIterator& other) const {
+        return ended == other.ended && (ended || current.range == other.current.range);
+    }
+
+  private:
+    const Spec* spec = nullptr;
+    std::string_view totalString;
+    std::string_view unanalyzed;
+
+    LexedToken current = {.kind = TokenKind::Error, .range = {0, 0}};
+    // current is an Error, after which there are no more tokens
+    bool stopped = false;
+    bool ended = true;
+};
+
+// the tokens of str, e.g. for (const LexedToken& token : Tokenize(spec, str))
+inline std::ranges::subrange<TokenIterator, std::default_sentinel_t>
+Tokenize(const Spec& spec, std::string_view str) {
+    return {TokenIterator(spec, str), std::default_sentinel};
+}
+
+} // namespace Calc
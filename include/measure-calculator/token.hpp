@@ -1,19 +1,52 @@
 #pragma once
 
 #include "data.hpp"
+#include "error.hpp"
+#include "spec-tables.hpp"
 
+#include <cstddef>
+#include <optional>
+#include <utility>
 #include <variant>
 
 namespace Calc {
 
+enum class TokenKind {
+    Number,
+    Constant,
+    Variable,
+    Unit,
+    UnaryFunction,
+    BinaryFunction,
+    Operator,
+    OpenParen,
+    CloseParen,
+    Comma,
+    // see LexedToken::error
+    Error,
+};
+
+// A token the way the evaluation lexes it, e.g. for syntax highlighting.
+struct LexedToken {
+    TokenKind kind;
+    // where the token is in the expression
+    std::pair<std::size_t, std::size_t> range;
+    // the measure of a Unit or a Variable, 0 otherwise
+    std::size_t measureId = 0;
+    // why the characters in range are not a token, only set for an Error
+    std::optional<Error> error = std::nullopt;
+
+    bool operator==(const LexedToken& other) const = default;
+};
+
 namespace Detail {
 
 namespace TokenData {
 
-using Operator = const Operator*;
+using Operator = const OperatorEntry*;
 
-using UnaryFun = const UnaryFun*;
-using BinaryFun = const BinaryFun*;
+using UnaryFun = const UnaryFunEntry*;
+using BinaryFun = const BinaryFunEntry*;
 
 using Value = double;
 
@@ -21,14 +54,16 @@ using Constant = const Constant*;
 
 using Measure = const Measure*;
 
+using Variable = const Variable*;
+
 struct OpenParen {};
 struct CloseParen {};
 struct Comma {};
 struct Error {};
 struct Eof {};
 
-using Any = std::variant<Operator, Measure, UnaryFun, BinaryFun, Constant, Value, OpenParen,
-                         CloseParen, Comma, Error, Eof>;
+using Any = std::variant<Operator, Measure, UnaryFun, BinaryFun, Constant, Variable, Value,
+                         OpenParen, CloseParen, Comma, Error, Eof>;
 
 } // namespace TokenData
 
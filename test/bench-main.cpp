@@ -0,0 +1,251 @@
+#include "measure-calculator/catalog.hpp"
+#include "measure-calculator/defaults.hpp"
+#include "measure-calculator/lexer.hpp"
+#include "measure-calculator/measure-calculator.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace Calc;
+
+namespace {
+
+template <class T>
+void DoNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile const T* sink;
+    sink = &value;
+#endif
+}
+
+// Hardware counters of the calling thread, or nothing where perf_event_open is not available
+// (e.g. not Linux, or forbidden by perf_event_paranoid).
+class PerfCounters {
+  public:
+    struct Values {
+        std::uint64_t cycles = 0;
+        std::uint64_t instructions = 0;
+        std::uint64_t cacheMisses = 0;
+    };
+
+    PerfCounters() {
+#ifdef __linux__
+        cycles = Open(PERF_COUNT_HW_CPU_CYCLES, -1);
+        if (cycles >= 0) {
+            instructions = Open(PERF_COUNT_HW_INSTRUCTIONS, cycles);
+            cacheMisses = Open(PERF_COUNT_HW_CACHE_MISSES, cycles);
+        }
+#endif
+    }
+
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    ~PerfCounters() {
+#ifdef __linux__
+        for (int fd : {cycles, instructions, cacheMisses}) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+#endif
+    }
+
+    bool Available() const { return cycles >= 0; }
+
+    void Start() {
+#ifdef __linux__
+        if (Available()) {
+            ioctl(cycles, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(cycles, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+#endif
+    }
+
+    std::optional<Values> Stop() {
+#ifdef __linux__
+        if (Available()) {
+            ioctl(cycles, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+            return Values{
+                .cycles = Read(cycles),
+                .instructions = Read(instructions),
+                .cacheMisses = Read(cacheMisses),
+            };
+        }
+#endif
+        return std::nullopt;
+    }
+
+  private:
+#ifdef __linux__
+    static int Open(std::uint64_t config, int groupFd) {
+        perf_event_attr attr{};
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = config;
+        attr.disabled = groupFd < 0 ? 1 : 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, groupFd, 0));
+    }
+
+    static std::uint64_t Read(int fd) {
+        std::uint64_t value = 0;
+        if (fd < 0 || read(fd, &value, sizeof(value)) != sizeof(value)) {
+            return 0;
+        }
+
+        return value;
+    }
+#endif
+
+    int cycles = -1;
+    int instructions = -1;
+    int cacheMisses = -1;
+};
+
+// Runs op until it took at least kMinDuration, and prints the cost of one run.
+template <class Op>
+void Bench(PerfCounters& counters, const char* name, Op&& op) {
+    using Clock = std::chrono::steady_clock;
+    constexpr auto kMinDuration = std::chrono::milliseconds(200);
+
+    std::uint64_t iterations = 1;
+    while (true) {
+        counters.Start();
+        const auto start = Clock::now();
+        for (std::uint64_t i = 0; i < iterations; ++i) {
+            op();
+        }
+        const auto elapsed = Clock::now() - start;
+        const auto values = counters.Stop();
+
+        if (elapsed < kMinDuration) {
+            iterations *= 2;
+            continue;
+        }
+
+        const auto n = static_cast<double>(iterations);
+        std::printf("%-40s %12.1f ns/op", name,
+                    std::chrono::duration<double, std::nano>(elapsed).count() / n);
+        if (values) {
+            std::printf(" %12.1f cycles %12.1f instructions %10.3f cache-misses",
+                        static_cast<double>(values->cycles) / n,
+                        static_cast<double>(values->instructions) / n,
+                        static_cast<double>(values->cacheMisses) / n);
+        }
+        std::printf("\n");
+        return;
+    }
+}
+
+SpecBuilder DefaultBuilder() {
+    return {
+        .unaryOps = Defaults::kNegateUnaryOp,
+        .binaryOps = Defaults::kArithmeticBinaryOps,
+        .unaryFuns = SpecUnion(Defaults::kBasicUnaryFuns, Defaults::kExponentialUnaryFuns,
+                               Defaults::kTrigonometricUnaryFuns),
+        .binaryFuns = Defaults::kBasicBinaryFuns,
+        .constants = Defaults::kBasicConstants,
+        .measures = {Defaults::kLinearMeasure, Defaults::kAngularMeasure},
+    };
+}
+
+// a builder with a constant for each of names besides the defaults
+SpecBuilder CatalogBuilder(const std::vector<std::string>& names) {
+    auto builder = DefaultBuilder();
+    for (const auto& name : names) {
+        builder.constants.emplace_back(name, static_cast<double>(builder.constants.size()));
+    }
+
+    return builder;
+}
+
+std::string Nested(std::size_t depth) {
+    std::string result;
+    for (std::size_t i = 0; i < depth; ++i) {
+        result += "(1 + ";
+    }
+    result += "1";
+    for (std::size_t i = 0; i < depth; ++i) {
+        result += ") * 2";
+    }
+
+    return result;
+}
+
+} // namespace
+
+int main() {
+    PerfCounters counters;
+    if (!counters.Available()) {
+        std::printf("hardware counters are not available, only reporting time\n");
+    }
+
+    const auto spec = std::get<Spec>(DefaultBuilder().Build());
+
+    const std::string_view shortExpression = "1 + 2 * 3";
+    const std::string_view mediumExpression =
+        "max(1 km, 2 * (30 m + 4e2 mm)) / -sqrt(16) + sin(pi / 4) * abs(-e)";
+    const auto nestedExpression = Nested(64);
+    const std::string_view unitExpression =
+        "1 km + 2 m + 3 cm + 4 mm + 5 ft + 6 in + 7 dm + 8 km + 9 m + 10 cm + 11 mm + 12 ft";
+
+    Bench(counters, "lex medium", [&] {
+        Detail::Lexer lexer{
+            .spec = spec,
+            .totalString = mediumExpression,
+            .unanalyzed = mediumExpression,
+            .curr = {.str = "", .data = Detail::TokenData::Error{}},
+        };
+        while (!lexer.Step() && !std::holds_alternative<Detail::TokenData::Eof>(lexer.curr.data)) {
+            DoNotOptimize(lexer.curr);
+        }
+    });
+
+    for (const auto& [name, expression] : {
+             std::pair<const char*, std::string_view>{"evaluate short", shortExpression},
+             {"evaluate medium", mediumExpression},
+             {"evaluate nested (depth 64)", nestedExpression},
+             {"evaluate unit heavy", unitExpression},
+         }) {
+        Bench(counters, name, [&] { DoNotOptimize(Evaluate(spec, expression)); });
+    }
+
+    std::vector<std::string> names;
+    for (std::size_t count : {10, 100, 1000, 10000, 100000}) {
+        while (names.size() < count) {
+            names.push_back("constant_" + std::to_string(names.size()));
+        }
+
+        const auto builder = CatalogBuilder(names);
+        const auto name = "build spec (" + std::to_string(count) + " constants)";
+        // including copying the builder, which Build() consumes
+        Bench(counters, name.c_str(), [&] { DoNotOptimize(SpecBuilder(builder).Build()); });
+    }
+
+    std::string catalogText = "measure\tlength\n";
+    for (std::size_t i = 0; i < 100000; ++i) {
+        catalogText += "unit\tunit_" + std::to_string(i) + "\t" + std::to_string(i + 1) + "\n";
+    }
+    Bench(counters, "load catalog (100000 units)", [&] {
+        std::istringstream input(catalogText);
+        DoNotOptimize(LoadCatalog(input));
+    });
+}
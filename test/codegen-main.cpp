@@ -0,0 +1,51 @@
+#include "measure-calculator/codegen.hpp"
+#include "measure-calculator/defaults.hpp"
+
+#include <array>
+#include <fstream>
+#include <iostream>
+
+using namespace Calc;
+
+// Writes the header of the formulas checked by the test cases to the path in argv[1].
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        std::cerr << "usage: " << argv[0] << " <output header>\n";
+        return 1;
+    }
+
+    auto spec = std::get<Spec>(SpecBuilder{
+        .unaryOps = Defaults::kNegateUnaryOp,
+        .binaryOps = Defaults::kArithmeticBinaryOps,
+        .unaryFuns = SpecUnion(Defaults::kBasicUnaryFuns, Defaults::kExponentialUnaryFuns,
+                               Defaults::kTrigonometricUnaryFuns),
+        .binaryFuns = Defaults::kBasicBinaryFuns,
+        .constants = Defaults::kBasicConstants,
+        .variables = {{"width", {.index = 0, .measureId = 1}},
+                      {"height", {.index = 1, .measureId = 1}},
+                      {"count", {.index = 2}}},
+        .measures = {Defaults::kLinearMeasure},
+    }
+                                   .Build());
+
+    constexpr std::array<NamedExpression, 3> kFormulas{{
+        {"Perimeter", "2 * (width + height) + 10 cm"},
+        {"Diagonal", "sqrt(pow(width, 2) + pow(height, 2)) / 1 mm"},
+        {"Spacing", "max(width - count * 5 mm, 0) / (count + 1)"},
+    }};
+
+    auto header = GenerateHeader(spec, kFormulas, "TestFormulas");
+    if (auto* error = std::get_if<GenerationError>(&header)) {
+        std::cerr << "cannot generate " << error->name << "\n";
+        return 1;
+    }
+
+    std::ofstream file(argv[1]);
+    file << std::get<std::string>(header);
+    if (!file) {
+        std::cerr << "cannot write " << argv[1] << "\n";
+        return 1;
+    }
+
+    return 0;
+}
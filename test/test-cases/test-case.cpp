@@ -1,7 +1,25 @@
 #include <doctest/doctest.h>
 
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include "measure-calculator/batch.hpp"
+#include "measure-calculator/catalog.hpp"
+#include "measure-calculator/codegen.hpp"
 #include "measure-calculator/defaults.hpp"
+#include "measure-calculator/diagnostics.hpp"
+#include "measure-calculator/edit-session.hpp"
+#include "measure-calculator/jit.hpp"
 #include "measure-calculator/measure-calculator.hpp"
+#include "measure-calculator/result-cache.hpp"
+#include "measure-calculator/snapshot.hpp"
+#include "measure-calculator/static-spec.hpp"
+#include "measure-calculator/token-iterator.hpp"
+
+#include "test-formulas.hpp"
 
 using namespace Calc;
 
@@ -17,6 +35,15 @@ struct Asserter {
     static auto WrapForCheck(Error e) { return e; }
     static auto WrapForCheck(double d) { return doctest::Approx(d); }
 
+    std::variant<double, Error> CompileAndEval(std::string_view str) const {
+        auto compiled = Compile(spec, str);
+        if (auto* error = std::get_if<Error>(&compiled)) {
+            return *error;
+        }
+
+        return std::get<CompiledExpression>(compiled).Eval();
+    }
+
     template <class T>
     void operator()(std::string_view str, T expected,
                     std::optional<T> noWhitespaceExpected = std::nullopt) const {
@@ -25,6 +52,10 @@ struct Asserter {
         CHECK_UNARY(std::holds_alternative<PureT>(result));
         CHECK_EQ(std::get<PureT>(result), WrapForCheck(expected));
 
+        auto compiledResult = CompileAndEval(str);
+        CHECK_UNARY(std::holds_alternative<PureT>(compiledResult));
+        CHECK_EQ(std::get<PureT>(compiledResult), WrapForCheck(expected));
+
         std::string noWhitespace(str.begin(), str.end());
         noWhitespace.erase(std::remove_if(noWhitespace.begin(), noWhitespace.end(), Detail::IsWhiteSpace),
                            noWhitespace.end());
@@ -33,6 +64,11 @@ struct Asserter {
         CHECK_UNARY(std::holds_alternative<PureT>(noWhitespaceResult));
         CHECK_EQ(std::get<PureT>(noWhitespaceResult),
                  WrapForCheck(noWhitespaceExpected.value_or(expected)));
+
+        auto noWhitespaceCompiledResult = CompileAndEval(noWhitespace);
+        CHECK_UNARY(std::holds_alternative<PureT>(noWhitespaceCompiledResult));
+        CHECK_EQ(std::get<PureT>(noWhitespaceCompiledResult),
+                 WrapForCheck(noWhitespaceExpected.value_or(expected)));
     }
 };
 
@@ -100,6 +136,13 @@ TEST_CASE("Spec Failure Modes") {
 
         buildsTo(SBError::NegativeMultiplier, {.measures = {{"name", {{"alma", -1}}}}});
     }
+
+    SUBCASE("Missing Functions") {
+        buildsTo(SBError::MissingFunction, {.unaryOps = {{"-", {.precedence = 1}}}});
+        buildsTo(SBError::MissingFunction, {.binaryOps = {{"-", {.precedence = 1}}}});
+        buildsTo(SBError::MissingFunction, {.unaryFuns = {{"f", {}}}});
+        buildsTo(SBError::MissingFunction, {.binaryFuns = {{"f", {.keepsMeasure = false}}}});
+    }
 }
 
 TEST_CASE("Numbers") {
@@ -238,9 +281,34 @@ TEST_CASE("Numbers") {
         assertion("123456789.123456789E-10", 123456789.123456789E-10);
     }
 
+    SUBCASE("Long Literals") {
+        assertion("123456789012345678901234567890", 123456789012345678901234567890.);
+        assertion("0.1234567890123456789", 0.1234567890123456789);
+        assertion("0.000000000000000000000000000001", 1e-30);
+        assertion("1e300", 1e300);
+        assertion("1e-300", 1e-300);
+    }
+
+    SUBCASE("Bounded Input") {
+        const std::string_view buffer = "12345";
+        CHECK_EQ(std::get<double>(Evaluate(assertion.spec, buffer.substr(0, 2))), 12.);
+        CHECK_EQ(std::get<double>(Evaluate(assertion.spec, buffer.substr(0, 1))), 1.);
+    }
+
     SUBCASE("Failure Modes") {
         assertion("1e1000000",
                   Error{.kind = Error::Kind::ConstantTooLarge, .invalidRange = {0, 9}});
+        assertion("1e-1000000",
+                  Error{.kind = Error::Kind::ConstantTooSmall, .invalidRange = {0, 10}});
+        assertion("(1e400)", Error{.kind = Error::Kind::ConstantTooLarge, .invalidRange = {1, 6}});
+        // subnormal values
+        assertion("1e-310", Error{.kind = Error::Kind::ConstantTooSmall, .invalidRange = {0, 6}});
+        assertion("4.9e-324",
+                  Error{.kind = Error::Kind::ConstantTooSmall, .invalidRange = {0, 8}});
+        assertion("2.2e-320",
+                  Error{.kind = Error::Kind::ConstantTooSmall, .invalidRange = {0, 8}});
+        assertion("2.3e-308", 2.3e-308);
+        assertion("1e", Error{.kind = Error::Kind::UnknownIdentifier, .invalidRange = {1, 2}});
         assertion(".a", Error{.kind = Error::Kind::DigitsExpected, .invalidRange = {0, 2}});
         assertion(".", Error{.kind = Error::Kind::DigitsExpected, .invalidRange = {0, 2}});
     }
@@ -600,3 +668,1295 @@ TEST_CASE("Posfix Binary ShortHand") {
                   {Error{.kind = Error::Kind::ValueExpected, .invalidRange = {2, 3}}});
     }
 }
+
+TEST_CASE("Compiled Expressions") {
+    auto spec = std::get<Spec>(SpecBuilder(kDefaultBuilder).Build());
+
+    SUBCASE("Reuse") {
+        auto compiled = Compile(spec, "1 km + 2 * 100 m * pi");
+        REQUIRE(std::holds_alternative<CompiledExpression>(compiled));
+
+        const auto& expression = std::get<CompiledExpression>(compiled);
+        for (int i = 0; i < 3; ++i) {
+            auto result = expression.Eval();
+            CHECK_UNARY(std::holds_alternative<double>(result));
+            CHECK_EQ(std::get<double>(result), doctest::Approx(1e3 + 2. * 100. * Defaults::pi));
+        }
+    }
+
+    SUBCASE("Deeper Than The Inline Stack") {
+        // with a variable innermost, so that it is not folded
+        auto builder = SpecBuilder(kDefaultBuilder);
+        builder.variables = {{"x", {.index = 0}}};
+        auto variableSpec = std::get<Spec>(std::move(builder).Build());
+
+        std::string nested;
+        for (int i = 0; i < 100; ++i) {
+            nested += "1 + (";
+        }
+        nested += "x";
+        nested.append(100, ')');
+
+        auto compiled = Compile(variableSpec, nested);
+        REQUIRE(std::holds_alternative<CompiledExpression>(compiled));
+
+        const std::array<double, 1> inputs{1.};
+        auto result = std::get<CompiledExpression>(compiled).Eval(inputs);
+        CHECK_UNARY(std::holds_alternative<double>(result));
+        CHECK_EQ(std::get<double>(result), doctest::Approx(101.));
+    }
+
+    SUBCASE("Constant Folding") {
+        auto builder = SpecBuilder(kDefaultBuilder);
+        builder.unaryFuns.push_back({"twice", {.func = [](double d) { return 2. * d; }}});
+        builder.variables = {{"x", {.index = 0}}};
+        auto variableSpec = std::get<Spec>(std::move(builder).Build());
+
+        const auto instructionCount = [&](std::string_view str) {
+            Detail::Interpreter<Detail::Compilation> compiler(variableSpec, str);
+            REQUIRE(compiler.Parse());
+            return compiler.backend.instructions.size();
+        };
+
+        CHECK_EQ(instructionCount("2 * pi * 100 m"), 1u);
+        CHECK_EQ(instructionCount("-sqrt(max(16, 9)) km + 1"), 1u);
+        CHECK_EQ(instructionCount("x * (2 + 3) + sin(pi / 2)"), 5u);
+        CHECK_EQ(instructionCount("twice(1)"), 2u);
+
+        // identities only where the check of the left out operation cannot fail
+        CHECK_EQ(instructionCount("(x + 1) * 1 m - 0 + 0 * 3"), 5u);
+        CHECK_EQ(instructionCount("1 * (x - 1) / 1"), 3u);
+        CHECK_EQ(instructionCount("x * 1"), 3u);
+        CHECK_EQ(instructionCount("exp(x) + 0"), 4u);
+        // x + 0 is not x for x = -0, but x + -0 is
+        CHECK_EQ(instructionCount("(x + 1) * 1 + 0"), 5u);
+        CHECK_EQ(instructionCount("(x + 1) * 1 + -0"), 3u);
+        CHECK_EQ(instructionCount("(x + 1) * 1 - -0"), 5u);
+
+        const std::array<double, 1> zero{0.};
+        for (std::string_view str : {"x * -1 + 0", "0 + x * -1", "x * -1 - -0", "x * -1 + -0"}) {
+            auto compiled = Compile(variableSpec, str);
+            REQUIRE(std::holds_alternative<CompiledExpression>(compiled));
+            const auto compiledResult = std::get<CompiledExpression>(compiled).Eval(zero);
+            const auto result = Evaluate(variableSpec, str, zero);
+            CHECK_EQ(compiledResult, result);
+            CHECK_EQ(std::signbit(std::get<double>(compiledResult)),
+                     std::signbit(std::get<double>(result)));
+        }
+
+        const std::array<double, 1> inputs{1e3};
+        for (std::string_view str : {"x * (2 + 3) + sin(pi / 2)", "(x + 1) * 1 m - 0 + 0 * 3",
+                                     "exp(x) + 0", "exp(1000) * 1", "1 / 0 * 1", "twice(2) * 1"}) {
+            auto compiled = Compile(variableSpec, str);
+            REQUIRE(std::holds_alternative<CompiledExpression>(compiled));
+            CHECK_EQ(std::get<CompiledExpression>(compiled).Eval(inputs),
+                     Evaluate(variableSpec, str, inputs));
+        }
+    }
+
+    SUBCASE("Failure Modes") {
+        auto compiled = Compile(spec, "1 km + sin");
+        CHECK_UNARY(std::holds_alternative<Error>(compiled));
+        CHECK_EQ(std::get<Error>(compiled),
+                 Error{.kind = Error::Kind::UnexpectedEof, .invalidRange = {10, 10}});
+
+        // arithmetic errors can only be detected by Eval()
+        auto divideByZero = Compile(spec, "2 / (1 - 1)");
+        REQUIRE(std::holds_alternative<CompiledExpression>(divideByZero));
+        CHECK_EQ(std::get<Error>(std::get<CompiledExpression>(divideByZero).Eval()),
+                 Error{.kind = Error::Kind::InfiniteValue, .invalidRange = {2, 3}});
+    }
+}
+
+TEST_CASE("Variables") {
+    auto builder = SpecBuilder(kDefaultBuilder);
+    builder.measures.push_back({"time", {{"sec", 1.}, {"h", 60. * 60.}}});
+    builder.variables = {
+        {"width", {.index = 0, .measureId = 1}},
+        {"margin", {.index = 1, .measureId = 1}},
+        {"count", {.index = 2}},
+        {"duration", {.index = 3, .measureId = 2}},
+    };
+    auto spec = std::get<Spec>(std::move(builder).Build());
+
+    const std::array<double, 4> inputs{3., 0.5, 4., 60.};
+
+    SUBCASE("Evaluate") {
+        CHECK_EQ(std::get<double>(Evaluate(spec, "width", inputs)), doctest::Approx(3.));
+        CHECK_EQ(std::get<double>(Evaluate(spec, "width * 2 m + margin", inputs)),
+                 doctest::Approx(6.5));
+        CHECK_EQ(std::get<double>(Evaluate(spec, "count * 1 km + width", inputs)),
+                 doctest::Approx(4003.));
+        CHECK_EQ(std::get<double>(Evaluate(spec, "duration + 1 h", inputs)),
+                 doctest::Approx(3660.));
+    }
+
+    SUBCASE("Compiled") {
+        auto compiled = Compile(spec, "width * 2 m + margin");
+        REQUIRE(std::holds_alternative<CompiledExpression>(compiled));
+
+        const auto& expression = std::get<CompiledExpression>(compiled);
+        CHECK_EQ(expression.InputCount(), 2u);
+        CHECK_EQ(std::get<double>(expression.Eval(inputs)), doctest::Approx(6.5));
+
+        const std::array<double, 2> otherInputs{10., 1.};
+        CHECK_EQ(std::get<double>(expression.Eval(otherInputs)), doctest::Approx(21.));
+    }
+
+    SUBCASE("Failure Modes") {
+        CHECK_EQ(std::get<Error>(Evaluate(spec, "1 + count")),
+                 Error{.kind = Error::Kind::UnboundVariable, .invalidRange = {4, 9}});
+        CHECK_EQ(std::get<Error>(Evaluate(spec, "width + duration", inputs)),
+                 Error{.kind = Error::Kind::MeasureMismatch,
+                       .invalidRange = {8, 16},
+                       .secondaryInvalidRange = {0, 5}});
+
+        auto compiled = Compile(spec, "count + width");
+        REQUIRE(std::holds_alternative<CompiledExpression>(compiled));
+        const std::array<double, 1> tooFewInputs{1.};
+        CHECK_EQ(std::get<Error>(std::get<CompiledExpression>(compiled).Eval(tooFewInputs)),
+                 Error{.kind = Error::Kind::UnboundVariable, .invalidRange = {0, 5}});
+
+        auto unknownMeasure = SpecBuilder{.variables = {{"x", {.index = 0, .measureId = 1}}}};
+        CHECK_EQ(std::get<SpecBuilder::Error>(std::move(unknownMeasure).Build()),
+                 SpecBuilder::Error::UnknownMeasure);
+    }
+}
+
+TEST_CASE("Columnar Evaluation") {
+    auto builder = SpecBuilder(kDefaultBuilder);
+    builder.binaryOps.push_back({"%", {.func = [](double a, double b) { return std::fmod(a, b); },
+                                       .precedence = 8}});
+    builder.variables = {{"x", {.index = 0, .measureId = 1}}, {"y", {.index = 1}}};
+    auto spec = std::get<Spec>(std::move(builder).Build());
+
+    constexpr std::size_t kRows = 1003;
+    std::vector<double> xs(kRows);
+    std::vector<double> ys(kRows);
+    for (std::size_t row = 0; row < kRows; ++row) {
+        xs[row] = static_cast<double>(row) * 0.5;
+        ys[row] = static_cast<double>(row % 7);
+    }
+    // its sign is kept too
+    xs[2] = -0.;
+    const std::array<std::span<const double>, 2> columns{xs, ys};
+
+    const auto matchesEval = [&](std::string_view str) {
+        auto compiled = Compile(spec, str);
+        REQUIRE(std::holds_alternative<CompiledExpression>(compiled));
+        const auto& expression = std::get<CompiledExpression>(compiled);
+
+        std::vector<double> results(kRows);
+        CHECK_UNARY_FALSE(expression.EvalColumns(columns, results));
+
+        for (std::size_t row = 0; row < kRows; ++row) {
+            const std::array<double, 2> inputs{xs[row], ys[row]};
+            auto expected = expression.Eval(inputs);
+            if (std::holds_alternative<Error>(expected)) {
+                CHECK_UNARY(std::isnan(results[row]));
+            } else {
+                CHECK_EQ(results[row], doctest::Approx(std::get<double>(expected)));
+                CHECK_EQ(std::signbit(results[row]), std::signbit(std::get<double>(expected)));
+            }
+        }
+    };
+
+    matchesEval("x");
+    matchesEval("x * 2 + 1 km");
+    matchesEval("-x / 3 mm - y");
+    matchesEval("max(x, 1 m) * sin(y) % 3");
+    matchesEval("x / y");
+    matchesEval("(x - x) / (y - y) + 1");
+    matchesEval("1 + (2 + (3 + (4 + (5 + (6 + (7 + (8 + (9 + (10 + y)))))))))");
+
+    SUBCASE("Failure Modes") {
+        auto compiled = Compile(spec, "x + y");
+        REQUIRE(std::holds_alternative<CompiledExpression>(compiled));
+        const auto& expression = std::get<CompiledExpression>(compiled);
+
+        std::vector<double> results(kRows + 1);
+        CHECK_EQ(expression.EvalColumns(columns, results),
+                 Error{.kind = Error::Kind::UnboundVariable, .invalidRange = {0, 1}});
+        CHECK_EQ(expression.EvalColumns(std::span(columns).first(1), results),
+                 Error{.kind = Error::Kind::UnboundVariable, .invalidRange = {4, 5}});
+    }
+}
+
+TEST_CASE("Longest Match") {
+    Asserter assertion = SpecBuilder{
+        .unaryOps = {{"-", {.func = std::negate<double>{}, .precedence = 12}}},
+        .binaryOps = {{"-", {.func = std::minus<double>{}, .precedence = 4}},
+                      {"--", {.func = std::plus<double>{}, .precedence = 4}}},
+        .constants = {{"x", 1.}, {"xy", 2.}, {"xyzw", 4.}},
+        .measures = {Defaults::kLinearMeasure},
+    };
+
+    assertion("100mm", 0.1);
+    assertion("1 m - 1 mm", 0.999);
+    assertion("xyzw", 4.);
+    assertion("xy", 2.);
+    assertion("3 -- 1", 4.);
+    assertion("3 --- 1", 2.);
+    assertion("xyz", Error{.kind = Error::Kind::UnknownIdentifier, .invalidRange = {2, 3}});
+    assertion("x yz", Error{.kind = Error::Kind::UnknownIdentifier, .invalidRange = {2, 4}},
+              {Error{.kind = Error::Kind::UnknownIdentifier, .invalidRange = {2, 3}}});
+}
+
+TEST_CASE("Builtins") {
+    Asserter assertion = SpecBuilder{
+        .unaryOps = {{"~", {.builtin = UnaryBuiltin::Sqrt, .precedence = 12}}},
+        .binaryOps = {{"+", {.builtin = BinaryBuiltin::Add, .precedence = 4}},
+                      {"^", {.builtin = BinaryBuiltin::Pow, .leftAssociative = false,
+                             .precedence = 10}},
+                      {"|", {.builtin = BinaryBuiltin::Max, .precedence = 2}}},
+        .unaryFuns = {{"neg", {.builtin = UnaryBuiltin::Negate}},
+                      {"twice", {.func = [](double a) { return a * 2.; }}}},
+        .binaryFuns = {{"sum", {.builtin = BinaryBuiltin::Add}},
+                       // func is only called for custom ones
+                       {"ratio", {.builtin = BinaryBuiltin::Divide,
+                                  .func = [](double, double) { return 0.; }}}},
+    };
+
+    assertion("2 ^ 3 ^ 2", 512.);
+    assertion("~16 + 1", 5.);
+    assertion("1 | 3 + 1 | 2", 4.);
+    assertion("neg(twice(2))", -4.);
+    assertion("sum(1, 2) + ratio(1, 4)", 3.25);
+    // only the operators fail on non-finite values
+    assertion("ratio(1, 0) | 1",
+              Error{.kind = Error::Kind::InfiniteValue, .invalidRange = {12, 13}},
+              {Error{.kind = Error::Kind::InfiniteValue, .invalidRange = {10, 11}}});
+    assertion("0 ^ neg(1)", Error{.kind = Error::Kind::InfiniteValue, .invalidRange = {2, 3}},
+              {Error{.kind = Error::Kind::InfiniteValue, .invalidRange = {1, 2}}});
+}
+
+namespace {
+
+constexpr auto kStaticUnaryFuns = Static::SpecUnion(Static::Defaults::kBasicUnaryFuns,
+                                                    Static::Defaults::kExponentialUnaryFuns,
+                                                    Static::Defaults::kTrigonometricUnaryFuns);
+
+constexpr std::array<std::pair<std::string_view, Static::BinaryOp>, 1> kStaticCustomOps{{
+    {"%", {.func = [](double a, double b) { return std::fmod(a, b); }, .precedence = 8}},
+}};
+
+constexpr std::array kStaticMeasures{Static::Defaults::kLinearMeasure};
+
+constexpr Static::SpecBuilder DefineStaticSpec() {
+    return {
+        .unaryOps = Static::Defaults::kNegateUnaryOp,
+        .binaryOps = Static::Defaults::kArithmeticBinaryOps,
+        .unaryFuns = kStaticUnaryFuns,
+        .binaryFuns = Static::Defaults::kBasicBinaryFuns,
+        .constants = Static::Defaults::kBasicConstants,
+        .measures = kStaticMeasures,
+    };
+}
+
+constexpr std::array<std::pair<std::string_view, Static::BinaryOp>, 1> kStaticMissingFunctionOps{{
+    {"%", {.precedence = 8}},
+}};
+
+constexpr std::array<std::pair<std::string_view, Constant>, 2> kDuplicateConstants{{
+    {"c", 1.},
+    {"c", 2.},
+}};
+
+} // namespace
+
+TEST_CASE("Static Spec") {
+    using SBError = SpecBuilder::Error;
+
+    static_assert(!StaticSpec<DefineStaticSpec>::kError);
+    static_assert(StaticSpec<[] {
+                      return Static::SpecBuilder{.constants = kDuplicateConstants};
+                  }>::kError == SBError::DuplicateIdentifier);
+    static_assert(StaticSpec<[] {
+                      return Static::SpecBuilder{.binaryOps = kStaticMissingFunctionOps};
+                  }>::kError == SBError::MissingFunction);
+
+    const auto& spec = StaticSpec<DefineStaticSpec>::Get();
+    const auto dynamicSpec = std::get<Spec>(SpecBuilder(kDefaultBuilder).Build());
+
+    for (std::string_view str : {"1 km + 2 * 100 m * pi", "-sqrt(16) mm / 2", "max(1, pow(2, 3))",
+                                 "sin(pi / 2) + abs(-e)", "1 / 0", "1 m + 2", "1 + unknown",
+                                 "2 ** 3"}) {
+        CHECK_EQ(Evaluate(spec, str), Evaluate(dynamicSpec, str));
+    }
+
+    auto compiled = Compile(spec, "2 * -3 mm");
+    REQUIRE(std::holds_alternative<CompiledExpression>(compiled));
+    CHECK_EQ(std::get<CompiledExpression>(compiled).Eval(), std::variant<double, Error>(-6e-3));
+
+    for (std::size_t measureId : {0, 1, 2}) {
+        const auto units = spec.UnitsOf(measureId);
+        const auto dynamicUnits = dynamicSpec.UnitsOf(measureId);
+        REQUIRE_EQ(units.size(), dynamicUnits.size());
+        for (std::size_t i = 0; i < units.size(); ++i) {
+            CHECK_EQ(units[i].name, dynamicUnits[i].name);
+        }
+    }
+
+    SUBCASE("Custom Functions") {
+        Asserter assertion = SpecBuilder{
+            .binaryOps = Static::ToSpecFor(kStaticCustomOps),
+        };
+        assertion("7 % 4", 3.);
+
+        const auto& customSpec = StaticSpec<[] {
+            return Static::SpecBuilder{.binaryOps = kStaticCustomOps};
+        }>::Get();
+        CHECK_EQ(Evaluate(customSpec, "7 % 4 % 2"), std::variant<double, Error>(1.));
+    }
+}
+
+TEST_CASE("Edit Session") {
+    auto builder = kDefaultBuilder;
+    builder.measures.push_back(Defaults::kAngularMeasure);
+    const auto spec = std::get<Spec>(std::move(builder).Build());
+
+    // the session must agree with evaluating its text from scratch
+    const auto edit = [&](EditSession& session, std::size_t offset, std::size_t removed,
+                          std::string_view inserted) {
+        const auto result = session.Edit(offset, removed, inserted);
+        CHECK_EQ(result, Evaluate(spec, session.Text()));
+        CHECK_EQ(session.Result(), result);
+    };
+
+    SUBCASE("Typing") {
+        EditSession session(spec);
+        const std::string_view text = "max(1 km, 2 * (30 m + 4e2 mm)) / -sqrt(16)";
+        for (std::size_t i = 0; i < text.size(); ++i) {
+            edit(session, i, 0, text.substr(i, 1));
+        }
+        CHECK_EQ(session.Text(), text);
+        CHECK_EQ(session.Result(), std::variant<double, Error>(-250.));
+
+        while (!session.Text().empty()) {
+            edit(session, session.Text().size() - 1, 1, "");
+        }
+    }
+
+    SUBCASE("Edits Merging Tokens") {
+        // the constant e right after a number
+        EditSession session(spec, "1e + 2");
+        CHECK_EQ(session.Result(), std::variant<double, Error>(Error{
+                                       .kind = Error::Kind::UnexpectedToken,
+                                       .invalidRange = {1, 2},
+                                   }));
+
+        edit(session, 2, 4, "5");
+        CHECK_EQ(session.Result(), std::variant<double, Error>(1e5));
+
+        edit(session, 1, 1, " ");
+        edit(session, 0, 0, "max(");
+        edit(session, session.Text().size(), 0, ", 7)");
+        CHECK_EQ(session.Text(), "max(1 5, 7)");
+        CHECK_EQ(session.Result(), std::variant<double, Error>(Error{
+                                       .kind = Error::Kind::UnexpectedToken,
+                                       .invalidRange = {6, 7},
+                                   }));
+
+        edit(session, 5, 1, "");
+        CHECK_EQ(session.Result(), std::variant<double, Error>(15.));
+    }
+
+    SUBCASE("Reused Groups") {
+        EditSession session(spec, "(1 km + (2 m)) + (3 + 4)");
+        edit(session, session.Text().size() - 2, 1, "40");
+        CHECK_EQ(session.Result(), std::variant<double, Error>(1045.));
+
+        edit(session, 17, 8, "3 rad");
+        CHECK_EQ(session.Result(), std::variant<double, Error>(Error{
+                                       .kind = Error::Kind::MeasureMismatch,
+                                       .invalidRange = {19, 22},
+                                       .secondaryInvalidRange = {11, 12},
+                                   }));
+
+        // the measure of the reused group points to its new place
+        edit(session, 0, 0, "1 + ");
+        CHECK_EQ(session.Result(), std::variant<double, Error>(Error{
+                                       .kind = Error::Kind::MeasureMismatch,
+                                       .invalidRange = {23, 26},
+                                       .secondaryInvalidRange = {15, 16},
+                                   }));
+
+        edit(session, 22, 4, "");
+        CHECK_EQ(session.Result(), std::variant<double, Error>(1006.));
+    }
+
+    SUBCASE("Edits After Errors") {
+        // the groups parsed after the first error are not reused, as their results are not valid
+        EditSession session(spec, "(max((4)+(2 km),sin(pi))) + (sin(((3 ft))))");
+        edit(session, 15, 7, "3");
+        CHECK_EQ(session.Text(), "(max((4)+(2 km)3))) + (sin(((3 ft))))");
+        edit(session, 27, 7, "");
+        CHECK_EQ(session.Result(), std::variant<double, Error>(Error{
+                                       .kind = Error::Kind::UnexpectedToken,
+                                       .invalidRange = {15, 16},
+                                   }));
+
+        edit(session, 15, 1, ", 3");
+        edit(session, 0, 0, "1 + ");
+    }
+
+    SUBCASE("Nesting Limit") {
+        auto shallowBuilder = SpecBuilder(kDefaultBuilder);
+        shallowBuilder.maxDepth = 5;
+        const auto shallow = std::get<Spec>(std::move(shallowBuilder).Build());
+
+        // the cached groups are too deep once wrapped
+        EditSession session(shallow, "((1+2))");
+        CHECK_EQ(session.Result(), std::variant<double, Error>(3.));
+        session.Edit(0, 0, "((");
+        session.Edit(session.Text().size(), 0, "))");
+        CHECK_EQ(session.Result(), Evaluate(shallow, "((((1+2))))"));
+        CHECK_EQ(session.Result(), std::variant<double, Error>(Error{
+                                       .kind = Error::Kind::NestingTooDeep,
+                                       .invalidRange = {6, 7},
+                                   }));
+
+        // and fit again once unwrapped
+        session.Edit(0, 1, "");
+        session.Edit(session.Text().size() - 1, 1, "");
+        CHECK_EQ(session.Result(), Evaluate(shallow, session.Text()));
+        CHECK_EQ(session.Result(), std::variant<double, Error>(3.));
+    }
+
+    SUBCASE("Clamping") {
+        EditSession session(spec, "1 + 2");
+        edit(session, 100, 100, " + 3");
+        CHECK_EQ(session.Text(), "1 + 2 + 3");
+        edit(session, 4, 100, "");
+        CHECK_EQ(session.Result(), std::variant<double, Error>(Error{
+                                       .kind = Error::Kind::ValueExpected,
+                                       .invalidRange = {4, 4},
+                                   }));
+    }
+}
+
+TEST_CASE("Result Cache") {
+    auto builder = SpecBuilder(kDefaultBuilder);
+    builder.variables = {{"width", {.index = 0}}};
+    const auto spec = std::get<Spec>(std::move(builder).Build());
+
+    const auto checkStats = [](const ResultCache& cache, std::size_t hits, std::size_t misses) {
+        CHECK_EQ(cache.GetStats().hits, hits);
+        CHECK_EQ(cache.GetStats().misses, misses);
+    };
+
+    SUBCASE("Canonical Form") {
+        ResultCache cache(spec, 16);
+        CHECK_EQ(cache.Evaluate("1 km+2*pi"), Evaluate(spec, "1 km+2*pi"));
+        checkStats(cache, 0, 1);
+
+        CHECK_EQ(cache.Evaluate("  1km + 2 * pi "), Evaluate(spec, "1 km+2*pi"));
+        CHECK_EQ(cache.Evaluate("1e3 m + 2.0 * pi"), Evaluate(spec, "1 km+2*pi"));
+        checkStats(cache, 1, 2);
+
+        CHECK_EQ(cache.Evaluate("1000 m + 2*pi"), Evaluate(spec, "1 km+2*pi"));
+        checkStats(cache, 2, 2);
+
+        // whitespace separating tokens still matters
+        CHECK_EQ(cache.Evaluate("1 2"), Evaluate(spec, "1 2"));
+        CHECK_EQ(cache.Evaluate("12"), std::variant<double, Error>(12.));
+        checkStats(cache, 2, 4);
+    }
+
+    SUBCASE("Not Cached") {
+        ResultCache cache(spec, 16);
+
+        // errors point into the text they were found in
+        CHECK_EQ(cache.Evaluate("1 / 0"), Evaluate(spec, "1 / 0"));
+        CHECK_EQ(cache.Evaluate(" 1/0"), Evaluate(spec, " 1/0"));
+        CHECK_EQ(cache.Evaluate("1 $ 2"), Evaluate(spec, "1 $ 2"));
+        CHECK_EQ(cache.Evaluate("width"), Evaluate(spec, "width"));
+        CHECK_EQ(cache.Evaluate("width"), Evaluate(spec, "width"));
+        checkStats(cache, 0, 5);
+    }
+
+    SUBCASE("Eviction") {
+        ResultCache cache(spec, 2);
+        cache.Evaluate("1");
+        cache.Evaluate("2");
+        cache.Evaluate("1");
+
+        // 2 was not used since it was inserted
+        cache.Evaluate("3");
+        checkStats(cache, 1, 3);
+        cache.Evaluate("1");
+        checkStats(cache, 2, 3);
+        cache.Evaluate("2");
+        checkStats(cache, 2, 4);
+    }
+
+    SUBCASE("Concurrent Use") {
+        ResultCache cache(spec, 8);
+        std::atomic<int> wrongResults = 0;
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&cache, &wrongResults, t] {
+                for (int i = 0; i < 200; ++i) {
+                    const auto n = (i * 7 + t) % 12;
+                    const auto str = std::to_string(n) + " * 2";
+                    if (cache.Evaluate(str) != std::variant<double, Error>(n * 2.)) {
+                        ++wrongResults;
+                    }
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+
+        CHECK_EQ(wrongResults.load(), 0);
+        CHECK_EQ(cache.GetStats().hits + cache.GetStats().misses, 800u);
+    }
+}
+
+TEST_CASE("Batch Evaluation") {
+    const auto spec = std::get<Spec>(SpecBuilder(kDefaultBuilder).Build());
+
+    std::vector<std::string> strings;
+    for (int i = 0; i < 1000; ++i) {
+        strings.push_back(std::to_string(i) + " m * 2" + (i % 7 == 0 ? " / 0" : " + 1 km"));
+    }
+    const std::vector<std::string_view> expressions(strings.begin(), strings.end());
+
+    for (std::size_t threads : {0, 1, 3}) {
+        std::vector<std::variant<double, Error>> results(expressions.size());
+        EvaluateBatch(spec, expressions, results, {.threads = threads});
+
+        for (std::size_t i = 0; i < expressions.size(); ++i) {
+            CHECK_EQ(results[i], Evaluate(spec, expressions[i]));
+        }
+    }
+
+    SUBCASE("Fewer Results") {
+        std::vector<std::variant<double, Error>> results(3, 0.);
+        EvaluateBatch(spec, expressions, std::span(results).first(2));
+        CHECK_EQ(results[1], Evaluate(spec, expressions[1]));
+        CHECK_EQ(results[2], std::variant<double, Error>(0.));
+    }
+
+    SUBCASE("Work Stealing") {
+        Detail::ThreadPool pool(4);
+
+        for (std::uint32_t count : {0u, 1u, 5u, 100u, 1001u}) {
+            std::vector<std::atomic<int>> taken(count);
+            Detail::WorkStealingRanges ranges(count, 4, 3);
+            pool.Run(4, [&](std::size_t participant) {
+                while (auto chunk = ranges.Next(participant)) {
+                    for (auto i = chunk->first; i < chunk->second; ++i) {
+                        ++taken[i];
+                    }
+                }
+            });
+
+            CHECK_UNARY(std::all_of(taken.begin(), taken.end(),
+                                    [](const std::atomic<int>& n) { return n == 1; }));
+        }
+    }
+}
+
+struct RecordingObserver : EvaluationObserver {
+    struct Record {
+        std::vector<std::string> tokens;
+        std::vector<std::pair<std::string, bool>> lookups;
+        std::size_t maxDepth = 0;
+        std::vector<std::pair<CallKind, std::string>> calls;
+        std::vector<Error> errors;
+    };
+
+    explicit RecordingObserver(Record& record) : record(&record) {}
+
+    void OnToken(std::string_view token) { record->tokens.emplace_back(token); }
+    void OnLookup(std::string_view name, bool found) { record->lookups.emplace_back(name, found); }
+    void OnDepth(std::size_t depth) { record->maxDepth = std::max(record->maxDepth, depth); }
+    void OnCall(CallKind kind, std::string_view name, std::chrono::nanoseconds duration) {
+        CHECK_GE(duration.count(), 0);
+        record->calls.emplace_back(kind, name);
+    }
+    void OnError(const Error& error) { record->errors.push_back(error); }
+
+    Record* record;
+};
+
+struct CallCountingObserver : EvaluationObserver {
+    void OnCall(CallKind, std::string_view, std::chrono::nanoseconds) { ++*calls; }
+
+    int* calls;
+};
+
+TEST_CASE("Observers") {
+    const auto spec = std::get<Spec>(SpecBuilder(kDefaultBuilder).Build());
+
+    SUBCASE("Events") {
+        RecordingObserver::Record record;
+        CHECK_EQ(Evaluate(spec, "-max(1 km, 2) * (3 + pi)", {}, RecordingObserver(record)),
+                 Evaluate(spec, "-max(1 km, 2) * (3 + pi)"));
+
+        CHECK_EQ(record.tokens, std::vector<std::string>{"-", "max", "(", "1", "km", ",", "2",
+                                                         ")", "*", "(", "3", "+", "pi", ")"});
+        CHECK_EQ(record.lookups,
+                 std::vector<std::pair<std::string, bool>>{
+                     {"-", true}, {"max", true}, {"km", true}, {"*", true}, {"+", true},
+                     {"pi", true}});
+        CHECK_EQ(record.maxDepth, 4u);
+        CHECK_EQ(record.calls, std::vector<std::pair<CallKind, std::string>>{
+                                   {CallKind::BinaryFunction, "max"},
+                                   {CallKind::UnaryOperator, "-"},
+                                   {CallKind::BinaryOperator, "+"},
+                                   {CallKind::BinaryOperator, "*"},
+                               });
+        CHECK_UNARY(record.errors.empty());
+    }
+
+    SUBCASE("Errors") {
+        RecordingObserver::Record record;
+        const auto result = Evaluate(spec, "1 + wat", {}, RecordingObserver(record));
+
+        CHECK_EQ(record.lookups,
+                 std::vector<std::pair<std::string, bool>>{{"+", true}, {"wat", false}});
+        CHECK_EQ(record.errors, std::vector<Error>{std::get<Error>(result)});
+    }
+
+    SUBCASE("Only Calls") {
+        int calls = 0;
+        Evaluate(spec, "abs(1 - 2) / 3", {}, CallCountingObserver{{}, &calls});
+        CHECK_EQ(calls, 3);
+    }
+}
+
+TEST_CASE("JIT") {
+    auto builder = SpecBuilder(kDefaultBuilder);
+    builder.unaryFuns.push_back({"twice", {.func = [](double d) { return 2. * d; }}});
+    builder.unaryFuns.push_back({"half", {.func = +[](double d) { return d / 2.; }}});
+    builder.binaryOps.push_back({"%", {.func = [](double a, double b) { return std::fmod(a, b); },
+                                       .precedence = 8}});
+    builder.variables = {{"x", {.index = 0, .measureId = 1}}, {"y", {.index = 1}}};
+    auto spec = std::get<Spec>(std::move(builder).Build());
+
+    const std::array<std::array<double, 2>, 4> inputs{{
+        {1.5, 2.},
+        {-3., 0.},
+        {0., 0.},
+        {1e300, 7.},
+    }};
+    for (std::string_view str : {"x * 2 + 1 km", "-x / 3 mm - y", "max(x, 1 m) * sin(y) % 3",
+                                 "abs(-x) + sqrt(y) - floor(x) * pow(y, 3)", "x / y",
+                                 "twice(half(x)) * x", "(x - x) / (y - y) + 1", "y", "2 * pi",
+                                 "1 + (2 + (3 + (4 + (5 + (6 + (7 + (8 + (9 + (10 + (11 + (12 + "
+                                 "(13 + (14 + (15 + (16 + (17 + y))))))))))))))))"}) {
+        auto compiled = Compile(spec, str);
+        REQUIRE(std::holds_alternative<CompiledExpression>(compiled));
+
+        const JitExpression jit(std::get<CompiledExpression>(compiled));
+#if defined(__linux__) && defined(__x86_64__)
+        CHECK_UNARY(jit.IsNative());
+#endif
+
+        for (const auto& row : inputs) {
+            CHECK_EQ(jit.Eval(row), jit.Compiled().Eval(row));
+        }
+
+        // missing inputs are reported the same way too
+        CHECK_EQ(jit.Eval(std::span(inputs[0]).first(0)),
+                 jit.Compiled().Eval(std::span(inputs[0]).first(0)));
+    }
+}
+
+TEST_CASE("Code Generation") {
+    // the spec of codegen-main.cpp, which generated test-formulas.hpp
+    auto builder = SpecBuilder(kDefaultBuilder);
+    builder.variables = {{"width", {.index = 0, .measureId = 1}},
+                         {"height", {.index = 1, .measureId = 1}},
+                         {"count", {.index = 2}}};
+    auto spec = std::get<Spec>(std::move(builder).Build());
+
+    SUBCASE("Generated Functions") {
+        const std::array<std::array<double, 3>, 3> inputs{{
+            {1.5, 2., 3.},
+            {0.25, 0.001, 0.},
+            {12., 3e-2, 1000.},
+        }};
+        for (const auto& row : inputs) {
+            const auto evaluate = [&](std::string_view str) {
+                return std::get<double>(Evaluate(spec, str, row));
+            };
+            const auto [width, height, count] = row;
+            CHECK_EQ(TestFormulas::Perimeter(width, height),
+                     evaluate("2 * (width + height) + 10 cm"));
+            CHECK_EQ(TestFormulas::Diagonal(width, height),
+                     evaluate("sqrt(pow(width, 2) + pow(height, 2)) / 1 mm"));
+            CHECK_EQ(TestFormulas::Spacing(width, count),
+                     evaluate("max(width - count * 5 mm, 0) / (count + 1)"));
+        }
+    }
+
+    SUBCASE("Header") {
+        const std::array<NamedExpression, 2> expressions{{
+            {"Area", "x * 2\t+ 3"},
+            {"Folded", "-(2 km / 4)"},
+        }};
+        builder = SpecBuilder(kDefaultBuilder);
+        builder.variables = {{"x", {.index = 1}}};
+        spec = std::get<Spec>(std::move(builder).Build());
+
+        CHECK_EQ(std::get<std::string>(GenerateHeader(spec, expressions, "Generated")),
+                 "#pragma once\n"
+                 "\n"
+                 "// generated by Calc::GenerateHeader\n"
+                 "\n"
+                 "#include <cmath>\n"
+                 "#include <limits>\n"
+                 "\n"
+                 "namespace Generated {\n"
+                 "\n"
+                 "// x * 2 + 3\n"
+                 "inline double Area(double input1 /* x */) {\n"
+                 "    return ((input1 * 2.0) + 3.0);\n"
+                 "}\n"
+                 "\n"
+                 "// -(2 km / 4)\n"
+                 "inline double Folded() {\n"
+                 "    return (-500.0);\n"
+                 "}\n"
+                 "\n"
+                 "} // namespace Generated\n");
+    }
+
+    SUBCASE("Errors") {
+        CHECK_EQ(std::get<GenerationError>(GenerateHeader(spec, std::array<NamedExpression, 1>{
+                                                                    {{"2nd", "width"}}})),
+                 GenerationError{.kind = GenerationError::Kind::InvalidName, .name = "2nd"});
+
+        const auto invalid = std::get<GenerationError>(
+            GenerateHeader(spec, std::array<NamedExpression, 1>{{{"Invalid", "width +"}}}));
+        CHECK_EQ(invalid.kind, GenerationError::Kind::InvalidExpression);
+        CHECK_EQ(invalid.name, "Invalid");
+        CHECK_EQ(invalid.error, std::get<Error>(Compile(spec, "width +")));
+
+        builder = SpecBuilder(kDefaultBuilder);
+        builder.unaryFuns.push_back({"twice", {.func = [](double d) { return 2. * d; }}});
+        spec = std::get<Spec>(std::move(builder).Build());
+        CHECK_EQ(std::get<GenerationError>(GenerateHeader(
+                     spec, std::array<NamedExpression, 1>{{{"Twice", "twice(2)"}}})),
+                 GenerationError{.kind = GenerationError::Kind::CustomFunction, .name = "Twice"});
+    }
+}
+
+TEST_CASE("Spec Outlives Its Builder") {
+    auto spec = [] {
+        std::vector<std::string> names{"length", "furlong", "chain"};
+        auto builder = SpecBuilder(kDefaultBuilder);
+        builder.measures = {{names[0], {{names[1], 201.168}, {names[2], 20.1168}}}};
+        auto built = std::get<Spec>(std::move(builder).Build());
+
+        // nothing may view them anymore
+        for (auto& name : names) {
+            std::fill(name.begin(), name.end(), '?');
+        }
+        return built;
+    }();
+
+    const auto units = spec.UnitsOf(1);
+    REQUIRE_EQ(units.size(), 2u);
+    CHECK_EQ(units[0].name, "furlong");
+    CHECK_EQ(units[1].name, "chain");
+    CHECK_EQ(spec.FindUnit("chain")->multiplier, 20.1168);
+    CHECK_EQ(Evaluate(spec, "1 furlong / 1 chain"), std::variant<double, Error>(10.));
+}
+
+TEST_CASE("Measured Results") {
+    auto builder = SpecBuilder(kDefaultBuilder);
+    builder.measures.push_back(Defaults::kAngularMeasure);
+    const auto spec = std::get<Spec>(std::move(builder).Build());
+
+    SUBCASE("Units") {
+        CHECK_EQ(spec.FindUnit("ft")->id, 1u);
+        CHECK_EQ(spec.FindUnit("ft")->multiplier, 0.3048);
+        CHECK_EQ(spec.FindUnit("rad")->id, 2u);
+        CHECK_UNARY(!spec.FindUnit("f"));
+        CHECK_UNARY(!spec.FindUnit("fts"));
+        CHECK_UNARY(!spec.FindUnit("pi"));
+
+        std::vector<std::string_view> names;
+        for (const auto& unit : spec.UnitsOf(1)) {
+            names.push_back(unit.name);
+        }
+        CHECK_EQ(names, std::vector<std::string_view>{"km", "m", "ft", "dm", "in", "cm", "mm"});
+        CHECK_EQ(spec.UnitsOf(2).size(), 7u);
+        CHECK_UNARY(spec.UnitsOf(0).empty());
+        CHECK_UNARY(spec.UnitsOf(3).empty());
+    }
+
+    SUBCASE("Evaluation") {
+        CHECK_EQ(std::get<MeasuredResult>(EvaluateMeasured(spec, "2 * 3")).measureId, 0u);
+
+        const auto result = std::get<MeasuredResult>(EvaluateMeasured(spec, "2 * (1 km + 3 m)"));
+        CHECK_EQ(result.value, 2006.);
+        CHECK_EQ(result.measureId, 1u);
+        CHECK_EQ(result.measureSource, std::pair<std::size_t, std::size_t>{14, 15});
+
+        CHECK_EQ(std::get<MeasuredResult>(EvaluateMeasured(spec, "90 °")).measureId, 2u);
+        CHECK_EQ(std::get<Error>(EvaluateMeasured(spec, "1 m + 1 rad")).kind,
+                 Error::Kind::MeasureMismatch);
+    }
+
+    SUBCASE("Conversion") {
+        const std::array<std::string_view, 2> feetAndInches{"ft", "in"};
+        std::array<double, 2> amounts{};
+
+        auto result = EvaluateIn(spec, "5 ft + 6.5 in", feetAndInches, amounts);
+        REQUIRE(std::holds_alternative<MeasuredResult>(result));
+        CHECK_EQ(amounts[0], 5.);
+        CHECK_EQ(amounts[1], doctest::Approx(6.5));
+
+        result = EvaluateIn(spec, "-1.7 m", feetAndInches, amounts);
+        REQUIRE(std::holds_alternative<MeasuredResult>(result));
+        CHECK_EQ(amounts[0], -5.);
+        CHECK_EQ(amounts[1], doctest::Approx(-0.176 / 0.0254));
+
+        // whole units are not split by rounding errors
+        for (const auto& [str, feet] :
+             {std::pair{"7 ft", 7.}, {"12 in", 1.}, {"14 ft", 14.}, {"-7 ft", -7.}}) {
+            result = EvaluateIn(spec, str, feetAndInches, amounts);
+            REQUIRE(std::holds_alternative<MeasuredResult>(result));
+            CHECK_EQ(amounts[0], feet);
+            CHECK_EQ(amounts[1], 0.);
+        }
+
+        // the same as dividing by the unit
+        result = EvaluateIn(spec, "3 m + 2 cm", std::span(feetAndInches).first(1), amounts);
+        REQUIRE(std::holds_alternative<MeasuredResult>(result));
+        CHECK_EQ(amounts[0], std::get<double>(Evaluate(spec, "(3 m + 2 cm) / 1 ft")));
+
+        CHECK_EQ(EvaluateIn(spec, "1 + 1 rad", feetAndInches, amounts),
+                 std::variant<MeasuredResult, Error>(Error{
+                     .kind = Error::Kind::MeasureMismatch,
+                     .invalidRange = {6, 9},
+                 }));
+        CHECK_EQ(std::get<Error>(EvaluateIn(spec, "2", feetAndInches, amounts)).kind,
+                 Error::Kind::MeasureMismatch);
+
+        const std::array<std::string_view, 1> unknown{"yd"};
+        CHECK_EQ(std::get<Error>(EvaluateIn(spec, "1 m", unknown, amounts)).kind,
+                 Error::Kind::UnknownUnit);
+    }
+}
+
+TEST_CASE("Snapshots") {
+    const auto path = std::filesystem::temp_directory_path() / "measure-calculator-test.snapshot";
+
+    auto builder = SpecBuilder(kDefaultBuilder);
+    builder.measures.push_back(Defaults::kAngularMeasure);
+    builder.unaryFuns.push_back({"twice", {.func = [](double d) { return 2. * d; }}});
+    builder.binaryOps.push_back({"%", {.func = [](double a, double b) { return std::fmod(a, b); },
+                                       .precedence = 8}});
+    builder.variables = {{"x", {.index = 0, .measureId = 1}}};
+    builder.usePostfixShorthand = true;
+    const auto spec = std::get<Spec>(std::move(builder).Build());
+
+    const CallableRegistry registry{
+        .unary = {{"twice", [](double d) { return 2. * d; }}},
+        .binary = {{"%", [](double a, double b) { return std::fmod(a, b); }}},
+    };
+
+    REQUIRE_UNARY(!SaveSnapshot(spec, path));
+
+    SUBCASE("Round Trip") {
+        auto loaded = LoadSnapshot(path, registry);
+        REQUIRE(std::holds_alternative<Spec>(loaded));
+        const auto& loadedSpec = std::get<Spec>(loaded);
+
+        const std::array<double, 1> inputs{2.};
+        for (std::string_view str :
+             {"1 km + twice(3 m) % 4", "-sqrt(16) mm / x", "90 ° + 1 rad", "1m2cm", "x + 1 rad",
+              "max(1, pow(2, 3)) + pi", "1 + unknown", "2 ** 3"}) {
+            CHECK_EQ(Evaluate(loadedSpec, str, inputs), Evaluate(spec, str, inputs));
+        }
+
+        CHECK_EQ(loadedSpec.FindUnit("ft")->multiplier, 0.3048);
+        CHECK_EQ(loadedSpec.UnitsOf(2).size(), spec.UnitsOf(2).size());
+        CHECK_EQ(loadedSpec.UnitsOf(1).front().name, "km");
+    }
+
+    SUBCASE("Static Spec") {
+        const auto staticPath = std::filesystem::path(path) += ".static";
+        REQUIRE_UNARY(!SaveSnapshot(StaticSpec<DefineStaticSpec>::Get(), staticPath));
+
+        auto loaded = LoadSnapshot(staticPath);
+        REQUIRE(std::holds_alternative<Spec>(loaded));
+        CHECK_EQ(Evaluate(std::get<Spec>(loaded), "1 km + 2 * 100 m * pi"),
+                 Evaluate(StaticSpec<DefineStaticSpec>::Get(), "1 km + 2 * 100 m * pi"));
+        std::filesystem::remove(staticPath);
+    }
+
+    SUBCASE("Errors") {
+        CHECK_EQ(std::get<SnapshotError>(LoadSnapshot(path)),
+                 SnapshotError{.kind = SnapshotError::Kind::MissingCallable, .name = "%"});
+        CHECK_EQ(std::get<SnapshotError>(LoadSnapshot(path, {.binary = registry.binary})),
+                 SnapshotError{.kind = SnapshotError::Kind::MissingCallable, .name = "twice"});
+
+        CHECK_EQ(std::get<SnapshotError>(LoadSnapshot(path.string() + ".missing")).kind,
+                 SnapshotError::Kind::CannotOpen);
+
+        // cut short
+        std::filesystem::resize_file(path, std::filesystem::file_size(path) / 2);
+        CHECK_EQ(std::get<SnapshotError>(LoadSnapshot(path, registry)).kind,
+                 SnapshotError::Kind::InvalidFormat);
+
+        std::ofstream(path, std::ios::binary | std::ios::trunc) << std::string(1000, '?');
+        CHECK_EQ(std::get<SnapshotError>(LoadSnapshot(path, registry)).kind,
+                 SnapshotError::Kind::InvalidFormat);
+    }
+
+    std::filesystem::remove(path);
+}
+
+TEST_CASE("Catalogs") {
+    SUBCASE("Loading") {
+        std::istringstream input("# lengths\n"
+                                 "measure\tlength\n"
+                                 "unit\tm\t1\n"
+                                 "unit\tft\t0.3048\r\n"
+                                 "\n"
+                                 "measure\tmass\n"
+                                 "unit\tkg\t1\n"
+                                 "unit\tg\t1e-3\n"
+                                 "constant\tg0\t9.80665\n");
+        auto catalog = std::get<Catalog>(LoadCatalog(input));
+        REQUIRE_EQ(catalog.measures.size(), 2u);
+        CHECK_EQ(catalog.measures[0].name, "length");
+        CHECK_EQ(catalog.measures[1].units.size(), 2u);
+
+        auto builder = SpecBuilder(kDefaultBuilder);
+        builder.measures = std::move(catalog.measures);
+        builder.constants = std::move(catalog.constants);
+        const auto spec = std::get<Spec>(std::move(builder).Build());
+        CHECK_EQ(Evaluate(spec, "3 ft + 1 m"), std::variant<double, Error>(1.9144));
+        CHECK_EQ(Evaluate(spec, "2 kg * g0 + 500 g"), std::variant<double, Error>(20.1133));
+        CHECK_EQ(std::get<Error>(Evaluate(spec, "1 kg + 1 m")).kind, Error::Kind::MeasureMismatch);
+    }
+
+    SUBCASE("Errors") {
+        const auto errorOf = [](const char* text) {
+            std::istringstream input(text);
+            return std::get<CatalogError>(LoadCatalog(input));
+        };
+
+        using Kind = CatalogError::Kind;
+        CHECK_EQ(errorOf("measure\tlength\nmeter\tm\t1\n"),
+                 CatalogError{.kind = Kind::UnknownRecord, .line = 2});
+        CHECK_EQ(errorOf("measure\n"), CatalogError{.kind = Kind::InvalidFieldCount, .line = 1});
+        CHECK_EQ(errorOf("constant\tc\t3e8\textra\n"),
+                 CatalogError{.kind = Kind::InvalidFieldCount, .line = 1});
+        CHECK_EQ(errorOf("measure\tlength\nunit\tm\tone\n"),
+                 CatalogError{.kind = Kind::InvalidNumber, .line = 2});
+        CHECK_EQ(errorOf("unit\tm\t1\n"),
+                 CatalogError{.kind = Kind::UnitWithoutMeasure, .line = 1});
+    }
+
+    SUBCASE("100k Entries") {
+        constexpr std::size_t kUnits = 80000;
+        constexpr std::size_t kConstants = 20000;
+
+        std::string text = "measure\tlength\n";
+        for (std::size_t i = 0; i < kUnits; ++i) {
+            text += "unit\tunit" + std::to_string(i) + "\t" + std::to_string(i + 1) + "\n";
+        }
+        for (std::size_t i = 0; i < kConstants; ++i) {
+            text += "constant\tconstant" + std::to_string(i) + "\t" + std::to_string(i) + "\n";
+        }
+
+        std::istringstream input(text);
+        auto catalog = std::get<Catalog>(LoadCatalog(input));
+        REQUIRE_EQ(catalog.measures.size(), 1u);
+        CHECK_EQ(catalog.measures[0].units.size(), kUnits);
+        CHECK_EQ(catalog.constants.size(), kConstants);
+
+        SpecBuilder builder{.binaryOps = Defaults::kArithmeticBinaryOps};
+        builder.measures = catalog.measures;
+        builder.constants = catalog.constants;
+        const auto spec = std::get<Spec>(std::move(builder).Build());
+
+        CHECK_EQ(Evaluate(spec, "2 unit0 + 1 unit79999"), std::variant<double, Error>(80002.));
+        CHECK_EQ(Evaluate(spec, "constant19999 * 1 unit41"), std::variant<double, Error>(839958.));
+        CHECK_EQ(spec.UnitsOf(1).size(), kUnits);
+        CHECK_EQ(spec.UnitsOf(1).front().name, "unit79999");
+        CHECK_EQ(std::get<Error>(Evaluate(spec, "unity")).kind,
+                 Error::Kind::UnknownIdentifier);
+
+        // a single duplicate among them
+        builder = SpecBuilder{.constants = catalog.constants, .measures = catalog.measures};
+        builder.constants.emplace_back("unit123", 1.);
+        CHECK_EQ(std::get<SpecBuilder::Error>(std::move(builder).Build()),
+                 SpecBuilder::Error::DuplicateIdentifier);
+    }
+}
+
+TEST_CASE("Diagnostics") {
+    auto builder = SpecBuilder(kDefaultBuilder);
+    builder.measures.push_back(Defaults::kAngularMeasure);
+    const auto spec = std::get<Spec>(std::move(builder).Build());
+
+    std::array<Error, 4> errors{};
+    const auto diagnose = [&](std::string_view str) {
+        const auto count = Diagnose(spec, str, errors);
+        return std::vector<Error>(errors.begin(), errors.begin() + std::min(count, errors.size()));
+    };
+
+    SUBCASE("Valid Expressions") {
+        CHECK_EQ(Diagnose(spec, "1 + 2 * sin(3 rad)", errors), 0u);
+        CHECK_EQ(Diagnose(spec, "max(1 km, 2 m) / 3", errors), 0u);
+    }
+
+    SUBCASE("The First Error Is Evaluate's") {
+        for (std::string_view str : {"1 + wat", "(1 + 2", "1 m + 1 rad", "1 / 0", ")", "1 2"}) {
+            CHECK_EQ(diagnose(str).front(), std::get<Error>(Evaluate(spec, str)));
+        }
+    }
+
+    SUBCASE("Every Error") {
+        CHECK_EQ(diagnose("1 + wat * (2 km + 3 rad) + max(4,"),
+                 std::vector<Error>{
+                     {.kind = Error::Kind::UnknownIdentifier, .invalidRange = {4, 7}},
+                     {
+                         .kind = Error::Kind::MeasureMismatch,
+                         .invalidRange = {20, 23},
+                         .secondaryInvalidRange = {13, 15},
+                     },
+                     {.kind = Error::Kind::ValueExpected, .invalidRange = {33, 33}},
+                 });
+        CHECK_EQ(diagnose("x + 1 / 0"),
+                 std::vector<Error>{
+                     {.kind = Error::Kind::UnknownIdentifier, .invalidRange = {0, 1}},
+                     {.kind = Error::Kind::InfiniteValue, .invalidRange = {6, 7}},
+                 });
+        CHECK_EQ(diagnose("(1 2) + 3 ) 4"),
+                 std::vector<Error>{
+                     {.kind = Error::Kind::UnexpectedToken, .invalidRange = {3, 4}},
+                     {.kind = Error::Kind::UnexpectedToken, .invalidRange = {10, 11}},
+                 });
+        CHECK_EQ(diagnose(")))"),
+                 std::vector<Error>{
+                     {.kind = Error::Kind::ValueExpected, .invalidRange = {0, 1}},
+                     {.kind = Error::Kind::UnexpectedToken, .invalidRange = {1, 2}},
+                     {.kind = Error::Kind::UnexpectedToken, .invalidRange = {2, 3}},
+                 });
+    }
+
+    SUBCASE("Errors Depending On Others Are Left Out") {
+        // the unknown value of wat is not infinite, and has no measure to mismatch
+        CHECK_EQ(diagnose("1 / wat + 1 m").size(), 1u);
+        // the missing paren is reported once
+        CHECK_EQ(diagnose("sin 1 + 2").size(), 1u);
+        CHECK_EQ(diagnose("max(1)").size(), 1u);
+    }
+
+    SUBCASE("Bounded Buffer") {
+        CHECK_EQ(Diagnose(spec, "a + b + c + d + w + z", errors), 6u);
+        CHECK_EQ(errors.back(),
+                 Error{.kind = Error::Kind::UnknownIdentifier, .invalidRange = {12, 13}});
+        CHECK_EQ(Diagnose(spec, "a + b", std::span<Error>()), 2u);
+    }
+}
+
+TEST_CASE("Completion") {
+    auto builder = SpecBuilder(kDefaultBuilder);
+    builder.measures.push_back(Defaults::kAngularMeasure);
+    const auto spec = std::get<Spec>(std::move(builder).Build());
+
+    std::array<Completion, 8> completions{};
+    const auto complete = [&](const Spec& spec, const CompletionQuery& query) {
+        const auto page = spec.Complete(query, completions);
+        std::vector<std::string_view> names;
+        for (std::size_t i = 0; i < page.count; ++i) {
+            names.push_back(completions[i].name);
+        }
+        return names;
+    };
+
+    using Names = std::vector<std::string_view>;
+    CHECK_EQ(complete(spec, {.prefix = "c"}), Names{"ceil", "cm", "cos", "cosh"});
+    CHECK_EQ(complete(spec, {.prefix = "co"}), Names{"cos", "cosh"});
+    CHECK_EQ(complete(spec, {.prefix = "cosh"}), Names{"cosh"});
+    CHECK_UNARY(complete(spec, {.prefix = "coshh"}).empty());
+    CHECK_UNARY(complete(spec, {.prefix = "z"}).empty());
+
+    CHECK_EQ(complete(spec, {.prefix = "c", .kind = IdentifierKind::UnaryFunction}),
+             Names{"ceil", "cos", "cosh"});
+    CHECK_EQ(complete(spec, {.prefix = "", .kind = IdentifierKind::Constant}), Names{"e", "pi"});
+    CHECK_EQ(complete(spec, {.prefix = "", .kind = IdentifierKind::Unit, .measureId = 2}),
+             Names{"\"", "'", "''", "rad", "turn", "°", "º"});
+    CHECK_EQ(completions[0].measureId, 2u);
+
+    SUBCASE("Pages") {
+        const std::span<Completion> page(completions.data(), 2);
+        CompletionQuery query{.prefix = "", .kind = IdentifierKind::Unit, .measureId = 1};
+        Names names;
+        std::size_t pages = 0;
+        while (true) {
+            const auto result = spec.Complete(query, page);
+            ++pages;
+            for (std::size_t i = 0; i < result.count; ++i) {
+                names.push_back(page[i].name);
+            }
+            if (!result.next) {
+                break;
+            }
+            query.cursor = *result.next;
+        }
+
+        CHECK_EQ(names, Names{"cm", "dm", "ft", "in", "km", "m", "mm"});
+        CHECK_EQ(pages, 4u);
+    }
+
+    SUBCASE("Every Kind Of Spec") {
+        const auto& staticSpec = StaticSpec<DefineStaticSpec>::Get();
+        const auto dynamicSpec = std::get<Spec>(SpecBuilder(kDefaultBuilder).Build());
+        CHECK_EQ(complete(staticSpec, {.prefix = "s"}), complete(dynamicSpec, {.prefix = "s"}));
+
+        const auto path = std::filesystem::temp_directory_path() / "completion-test.mcspec";
+        REQUIRE_UNARY(!SaveSnapshot(spec, path));
+        const auto loaded = std::get<Spec>(LoadSnapshot(path));
+        std::filesystem::remove(path);
+        CHECK_EQ(complete(loaded, {.prefix = "c"}), complete(spec, {.prefix = "c"}));
+    }
+}
+
+struct LexingObserver : EvaluationObserver {
+    std::vector<LexedToken>* tokens;
+
+    void OnLexed(const LexedToken& token) { tokens->push_back(token); }
+};
+
+TEST_CASE("Token Iterator") {
+    const auto spec = std::get<Spec>(SpecBuilder(kDefaultBuilder).Build());
+
+    const auto tokensOf = [&](std::string_view str) {
+        std::vector<LexedToken> result;
+        for (const auto& token : Tokenize(spec, str)) {
+            result.push_back(token);
+        }
+        return result;
+    };
+    const auto token = [](TokenKind kind, std::size_t first, std::size_t last,
+                          std::size_t measureId = 0) {
+        return LexedToken{.kind = kind, .range = {first, last}, .measureId = measureId};
+    };
+
+    CHECK_UNARY(tokensOf("").empty());
+    CHECK_UNARY(tokensOf("  ").empty());
+
+    // the unit is matched right after the number, as the longest name it starts with
+    CHECK_EQ(tokensOf("2km*pi + max(x_1, 3)"),
+             std::vector<LexedToken>{
+                 token(TokenKind::Number, 0, 1),
+                 token(TokenKind::Unit, 1, 3, 1),
+                 token(TokenKind::Operator, 3, 4),
+                 token(TokenKind::Constant, 4, 6),
+                 token(TokenKind::Operator, 7, 8),
+                 token(TokenKind::BinaryFunction, 9, 12),
+                 token(TokenKind::OpenParen, 12, 13),
+                 {
+                     .kind = TokenKind::Error,
+                     .range = {13, 16},
+                     .error =
+                         Error{.kind = Error::Kind::UnknownIdentifier, .invalidRange = {13, 16}},
+                 },
+             });
+
+    // an error ends the tokens, even if more could follow
+    const auto dot = tokensOf("sin(1) . 2");
+    REQUIRE_EQ(dot.size(), 5u);
+    CHECK_EQ(dot[3], token(TokenKind::CloseParen, 5, 6));
+    CHECK_EQ(dot[4].kind, TokenKind::Error);
+    CHECK_EQ(dot[4].range, std::pair<std::size_t, std::size_t>{7, 9});
+
+    SUBCASE("Lexed While Evaluating") {
+        std::vector<LexedToken> lexed;
+        const std::string_view str = "-abs(1 mm - 2 in) / (3 + e)";
+        CHECK_EQ(Evaluate(spec, str, {}, LexingObserver{{}, &lexed}), Evaluate(spec, str));
+        CHECK_EQ(lexed, tokensOf(str));
+    }
+}
+
+TEST_CASE("Nesting Limit") {
+    const auto spec = std::get<Spec>(SpecBuilder(kDefaultBuilder).Build());
+
+    SUBCASE("Deep Expressions Fail Instead of Overflowing") {
+        const auto parens = std::string(100000, '(') + "1" + std::string(100000, ')');
+        const auto tooDeep =
+            Error{.kind = Error::Kind::NestingTooDeep, .invalidRange = {1000, 1001}};
+        CHECK_EQ(std::get<Error>(Evaluate(spec, parens)), tooDeep);
+        CHECK_EQ(std::get<Error>(Compile(spec, parens)), tooDeep);
+        CHECK_EQ(std::get<Error>(Evaluate(spec, std::string(100000, '-') + "1")), tooDeep);
+
+        std::array<Error, 4> errors;
+        CHECK_EQ(Diagnose(spec, parens, errors), 1u);
+        CHECK_EQ(errors[0], tooDeep);
+    }
+
+    SUBCASE("Within the Limit") {
+        std::string nested = "1";
+        for (int i = 0; i < 300; ++i) {
+            nested = "abs(-(" + nested + ")) + 1";
+        }
+        CHECK_EQ(std::get<double>(Evaluate(spec, nested)), 301.);
+    }
+
+    SUBCASE("Configured Limit") {
+        auto builder = SpecBuilder(kDefaultBuilder);
+        builder.maxDepth = 4;
+        const auto shallow = std::get<Spec>(std::move(builder).Build());
+
+        CHECK_EQ(std::get<double>(Evaluate(shallow, "(1 + (2))")), 3.);
+        CHECK_EQ(std::get<Error>(Evaluate(shallow, "(1 + (-2))")),
+                 Error{.kind = Error::Kind::NestingTooDeep, .invalidRange = {7, 8}});
+    }
+}
+
+TEST_CASE("Char Classification") {
+    SUBCASE("Classes") {
+        for (const char c : std::string_view(" \t\n\v\f\r")) {
+            CHECK_UNARY(Detail::IsWhiteSpace(c));
+            CHECK_UNARY(!Detail::IsIdentifierChar(c));
+        }
+        for (const char c : std::string_view("+-*/^")) {
+            CHECK_UNARY(Detail::IsOperatorChar(c));
+            CHECK_UNARY(!Detail::IsIdentifierChar(c));
+        }
+        CHECK_UNARY(Detail::IsIdentifierChar('7'));
+        CHECK_UNARY(!Detail::IsIdentifierStartChar('7'));
+        CHECK_UNARY(Detail::IsIdentifierStartChar('\xC2'));
+        CHECK_UNARY(Detail::IsIdentifierStartChar('"'));
+        CHECK_UNARY(!Detail::IsIdentifierStartChar(','));
+    }
+
+    SUBCASE("Long Runs") {
+        // the runs end at every position of a 16 char block, and with non-matching chars
+        // the vector instructions do not take
+        for (std::size_t length = 0; length < 40; ++length) {
+            const auto padding = std::string(length, ' ') + "\t\r\n";
+            CHECK_EQ(Detail::RunLength(padding + "1", Detail::kWhiteSpace), length + 3);
+            CHECK_EQ(Detail::RunLength(std::string(length, '9') + ".5", Detail::kDigit), length);
+
+            const auto name = std::string(length, 'x') + "_1\xC2\xB0\"'$";
+            CHECK_EQ(Detail::RunLength(name + "+y", Detail::kIdentifierChar), name.size());
+            CHECK_EQ(Detail::RunLength(name, Detail::kIdentifierChar), name.size());
+        }
+    }
+
+    SUBCASE("Padded Expressions") {
+        const auto spec = std::get<Spec>(SpecBuilder(kDefaultBuilder).Build());
+        const auto padding = std::string(37, ' ');
+        const auto str = padding + "1" + padding + "+" + padding + "\tmax(2 km," + padding +
+                         "3000000000000000000000 m)" + padding;
+        CHECK_EQ(std::get<double>(Evaluate(spec, str)), doctest::Approx(3e21 + 1));
+        CHECK_EQ(std::get<Error>(Evaluate(spec, padding + "unknown_identifier_longer_than_16")),
+                 Error{.kind = Error::Kind::UnknownIdentifier, .invalidRange = {37, 70}});
+    }
+}
@@ -0,0 +1,353 @@
+#include "measure-calculator/batch.hpp"
+#include "measure-calculator/defaults.hpp"
+#include "measure-calculator/measure-calculator.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <variant>
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define MEASURE_CALC_HAS_MMAP 1
+#endif
+
+using namespace Calc;
+
+namespace {
+
+// the lines evaluated in parallel at once, and their results written before the next ones
+constexpr std::size_t kLinesPerBlock = 1 << 16;
+
+enum class Format {
+    Tsv,
+    Ndjson,
+};
+
+struct Options {
+    Format format = Format::Tsv;
+    BatchOptions batch = {};
+    // read from stdin if empty
+    const char* path = nullptr;
+};
+
+// Splits the input into lines, handing out the next ones in blocks. The lines of a block stay
+// valid until the next block is requested.
+class LineReader {
+  public:
+    LineReader() = default;
+    LineReader(const LineReader&) = delete;
+    LineReader& operator=(const LineReader&) = delete;
+
+    ~LineReader() {
+#ifdef MEASURE_CALC_HAS_MMAP
+        if (mapping) {
+            munmap(mapping, mappingSize);
+        }
+#endif
+        if (file && file != stdin) {
+            std::fclose(file);
+        }
+    }
+
+    // reads the file at path, or stdin if it is null
+    bool Open(const char* path) {
+        if (!path) {
+            Stream(stdin);
+            return true;
+        }
+
+#ifdef MEASURE_CALC_HAS_MMAP
+        // regular files are mapped instead of copied
+        if (const int fd = open(path, O_RDONLY); fd >= 0) {
+            struct stat info {};
+            if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+                mappingSize = static_cast<std::size_t>(info.st_size);
+                mapping = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+                close(fd);
+                if (mapping == MAP_FAILED) {
+                    mapping = nullptr;
+                    return false;
+                }
+
+                madvise(mapping, mappingSize, MADV_SEQUENTIAL);
+                data = {static_cast<const char*>(mapping), mappingSize};
+                return true;
+            }
+            close(fd);
+        }
+#endif
+
+        std::FILE* opened = std::fopen(path, "rb");
+        if (!opened) {
+            return false;
+        }
+
+        Stream(opened);
+        return true;
+    }
+
+    // Fills lines with the next lines (without their line breaks), at most as many as it holds.
+    // Returns how many there are, 0 once the input is over.
+    std::size_t NextBlock(std::span<std::string_view> lines) {
+        std::size_t count = 0;
+        while (count < lines.size()) {
+            const auto rest = data.substr(position);
+            const auto end = rest.find('\n');
+            if (end == std::string_view::npos && !Exhausted()) {
+                if (count > 0) {
+                    // the lines handed out still view the buffer
+                    break;
+                }
+
+                Refill();
+                continue;
+            }
+
+            if (rest.empty()) {
+                break;
+            }
+
+            auto line = rest.substr(0, end);
+            position += end == std::string_view::npos ? rest.size() : end + 1;
+            if (!line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+            lines[count++] = line;
+        }
+
+        return count;
+    }
+
+    bool Failed() const { return file && std::ferror(file); }
+
+  private:
+    static constexpr std::size_t kInitialBufferSize = 1 << 22;
+
+    void Stream(std::FILE* source) {
+        file = source;
+        buffer.resize(kInitialBufferSize);
+    }
+
+    bool Exhausted() const { return !file || std::feof(file) || std::ferror(file); }
+
+    // moves the unread part to the front of the buffer, and reads after it
+    void Refill() {
+        const auto unread = data.size() - position;
+        std::memmove(buffer.data(), buffer.data() + position, unread);
+        if (unread == buffer.size()) {
+            // a line longer than the buffer
+            buffer.resize(buffer.size() * 2);
+        }
+
+        const auto read =
+            std::fread(buffer.data() + unread, 1, buffer.size() - unread, file);
+        data = {buffer.data(), unread + read};
+        position = 0;
+    }
+
+    std::FILE* file = nullptr;
+    std::vector<char> buffer;
+
+    void* mapping = nullptr;
+    std::size_t mappingSize = 0;
+
+    // the part of the input in memory, of which the lines from position on are not handed out
+    std::string_view data;
+    std::size_t position = 0;
+};
+
+// Collects the output in a fixed buffer, writing it to stdout whenever it is full.
+class Writer {
+  public:
+    Writer() : buffer(kBufferSize) {}
+
+    ~Writer() { Flush(); }
+
+    void Write(std::string_view str) {
+        if (str.size() > buffer.size() - used) {
+            Flush();
+            if (str.size() > buffer.size()) {
+                failed |= std::fwrite(str.data(), 1, str.size(), stdout) != str.size();
+                return;
+            }
+        }
+
+        std::memcpy(buffer.data() + used, str.data(), str.size());
+        used += str.size();
+    }
+
+    template <class Number>
+    void WriteNumber(Number value) {
+        if constexpr (std::is_floating_point_v<Number>) {
+            // to_chars writes the sign of NaNs too
+            if (std::isnan(value)) {
+                Write("nan");
+                return;
+            }
+        }
+
+        // the longest double in its shortest round-tripping form
+        constexpr std::size_t kMaxLength = 32;
+        if (buffer.size() - used < kMaxLength) {
+            Flush();
+        }
+
+        used = std::to_chars(buffer.data() + used, buffer.data() + buffer.size(), value).ptr -
+               buffer.data();
+    }
+
+    void Flush() {
+        failed |= std::fwrite(buffer.data(), 1, used, stdout) != used;
+        used = 0;
+    }
+
+    bool Failed() const { return failed; }
+
+  private:
+    static constexpr std::size_t kBufferSize = 1 << 20;
+
+    std::vector<char> buffer;
+    std::size_t used = 0;
+    bool failed = false;
+};
+
+// TSV: the value (inf, -inf or nan if it is not finite), or an empty value and the kind and range
+// of the error
+void WriteTsv(Writer& writer, const std::variant<double, Error>& result) {
+    if (const auto* value = std::get_if<double>(&result)) {
+        writer.WriteNumber(*value);
+        writer.Write("\n");
+        return;
+    }
+
+    const auto& error = std::get<Error>(result);
+    writer.Write("\t");
+    writer.Write(KindName(error.kind));
+    writer.Write("\t");
+    writer.WriteNumber(error.invalidRange.first);
+    writer.Write("\t");
+    writer.WriteNumber(error.invalidRange.second);
+    writer.Write("\n");
+}
+
+// NDJSON: the value, or the kind and range of the error. Infinities and NaNs, which functions
+// may still return, are written as the strings "inf", "-inf" and "nan", as JSON has no numbers
+// for them.
+void WriteNdjson(Writer& writer, const std::variant<double, Error>& result) {
+    if (const auto* value = std::get_if<double>(&result)) {
+        writer.Write(R"({"value":)");
+        if (std::isfinite(*value)) {
+            writer.WriteNumber(*value);
+        } else {
+            writer.Write("\"");
+            writer.WriteNumber(*value);
+            writer.Write("\"");
+        }
+        writer.Write("}\n");
+        return;
+    }
+
+    const auto& error = std::get<Error>(result);
+    writer.Write(R"({"error":")");
+    writer.Write(KindName(error.kind));
+    writer.Write(R"(","range":[)");
+    writer.WriteNumber(error.invalidRange.first);
+    writer.Write(",");
+    writer.WriteNumber(error.invalidRange.second);
+    writer.Write("]}\n");
+}
+
+std::optional<Options> ParseOptions(int argc, char** argv) {
+    Options result;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        if (arg == "--tsv") {
+            result.format = Format::Tsv;
+        } else if (arg == "--ndjson") {
+            result.format = Format::Ndjson;
+        } else if (arg == "--threads" && i + 1 < argc) {
+            const std::string_view threads = argv[++i];
+            const auto [end, error] = std::from_chars(threads.data(),
+                                                      threads.data() + threads.size(),
+                                                      result.batch.threads);
+            if (error != std::errc() || end != threads.data() + threads.size()) {
+                return std::nullopt;
+            }
+        } else if (arg != "-" && arg.starts_with("-")) {
+            return std::nullopt;
+        } else if (!result.path && arg != "-") {
+            result.path = argv[i];
+        } else if (result.path || arg != "-") {
+            return std::nullopt;
+        }
+    }
+
+    return result;
+}
+
+} // namespace
+
+// Evaluates each line of a file (or stdin) and writes a line with its result to stdout, in the
+// order of the input.
+int main(int argc, char** argv) {
+    const auto options = ParseOptions(argc, argv);
+    if (!options) {
+        std::fprintf(stderr, "usage: %s [--tsv | --ndjson] [--threads N] [FILE | -]\n", argv[0]);
+        return 2;
+    }
+
+    LineReader reader;
+    if (!reader.Open(options->path)) {
+        std::fprintf(stderr, "cannot open %s\n", options->path);
+        return 1;
+    }
+
+    const auto spec = std::get<Spec>(SpecBuilder{
+        .unaryOps = Defaults::kNegateUnaryOp,
+        .binaryOps = Defaults::kArithmeticBinaryOps,
+        .unaryFuns = SpecUnion(Defaults::kBasicUnaryFuns, Defaults::kExponentialUnaryFuns,
+                               Defaults::kTrigonometricUnaryFuns),
+        .binaryFuns = Defaults::kBasicBinaryFuns,
+        .constants = Defaults::kBasicConstants,
+        .measures = {Defaults::kLinearMeasure, Defaults::kAngularMeasure},
+    }
+                                         .Build());
+
+    const auto write = options->format == Format::Tsv ? WriteTsv : WriteNdjson;
+
+    std::vector<std::string_view> lines(kLinesPerBlock);
+    std::vector<std::variant<double, Error>> results(kLinesPerBlock);
+    Writer writer;
+    while (const auto count = reader.NextBlock(lines)) {
+        EvaluateBatch(spec, std::span(lines).first(count), std::span(results).first(count),
+                      options->batch);
+        for (std::size_t i = 0; i < count; ++i) {
+            write(writer, results[i]);
+        }
+    }
+    writer.Flush();
+
+    if (reader.Failed()) {
+        std::fprintf(stderr, "cannot read the input\n");
+        return 1;
+    }
+    if (writer.Failed()) {
+        std::fprintf(stderr, "cannot write the output\n");
+        return 1;
+    }
+
+    return 0;
+}